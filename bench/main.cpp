@@ -0,0 +1,279 @@
+#include "crypto.h"
+#include "ratchet_tree.h"
+#include "session.h"
+#include "state.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+// Microbenchmarks for the hot protocol paths:
+//
+// * The HKDF helpers in src/crypto.cpp
+// * ApplicationKeyChain::get
+// * RatchetTree::encrypt / decrypt
+// * State::derive_epoch_secrets (the dominant cost inside
+//   State::handle) and State::handle itself
+//
+// Each benchmark reports per-op latency and the number of heap
+// allocations per op, so that releases can be gated on regressions.
+// By default we sweep a modest set of group sizes; pass `--large` to
+// extend the sweep up to 100k leaves (slow), and an integer argument
+// to change the iteration count.
+
+using namespace mls;
+
+///
+/// Allocation counting
+///
+/// We count every operator new/delete so that benchmarks can report
+/// allocations per op alongside latency.
+///
+
+static std::atomic<uint64_t> alloc_count{ 0 };
+
+void*
+operator new(size_t size)
+{
+  alloc_count += 1;
+  auto ptr = std::malloc(size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void
+operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete(void* ptr, size_t /* size */) noexcept
+{
+  std::free(ptr);
+}
+
+///
+/// Benchmark harness
+///
+
+struct BenchResult
+{
+  double ns_per_op;
+  double allocs_per_op;
+};
+
+template<typename F>
+BenchResult
+run_bench(int iterations, const F& body)
+{
+  // Warm up once so that lazily initialized state (OpenSSL tables,
+  // etc.) doesn't land in the measurement
+  body();
+
+  auto allocs_before = alloc_count.load();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i += 1) {
+    body();
+  }
+  auto end = std::chrono::steady_clock::now();
+  auto allocs_after = alloc_count.load();
+
+  auto elapsed =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  return BenchResult{ double(elapsed) / iterations,
+                      double(allocs_after - allocs_before) / iterations };
+}
+
+template<typename F>
+void
+report(const std::string& name, int iterations, const F& body)
+{
+  auto result = run_bench(iterations, body);
+  std::cout << name << " " << result.ns_per_op << " ns/op " << " "
+            << result.allocs_per_op << " allocs/op" << std::endl;
+}
+
+static std::string
+suite_name(CipherSuite suite)
+{
+  switch (suite) {
+    case CipherSuite::P256_SHA256_AES128GCM:
+      return "P256_SHA256_AES128GCM";
+    case CipherSuite::P521_SHA512_AES256GCM:
+      return "P521_SHA512_AES256GCM";
+    case CipherSuite::X25519_SHA256_AES128GCM:
+      return "X25519_SHA256_AES128GCM";
+    case CipherSuite::X448_SHA512_AES256GCM:
+      return "X448_SHA512_AES256GCM";
+  }
+
+  return "unknown";
+}
+
+///
+/// Individual benchmarks
+///
+
+static void
+bench_hkdf(CipherSuite suite, int iterations)
+{
+  auto base = suite_name(suite);
+  auto secret_size = Digest(suite).output_size();
+  auto secret = random_bytes(secret_size);
+  auto salt = random_bytes(secret_size);
+  auto context = random_bytes(secret_size);
+
+  report(base + "/hkdf_extract", iterations, [&]() {
+    hkdf_extract(suite, salt, secret);
+  });
+
+  report(base + "/hkdf_expand_label", iterations, [&]() {
+    hkdf_expand_label(suite, secret, "bench", context, secret_size);
+  });
+
+  report(base + "/derive_secret", iterations, [&]() {
+    derive_secret(suite, secret, "bench", context);
+  });
+}
+
+static void
+bench_app_key_chain(CipherSuite suite, int iterations)
+{
+  auto base = suite_name(suite);
+  auto secret_size = Digest(suite).output_size();
+  auto app_secret = random_bytes(secret_size);
+  ApplicationKeyChain chain(suite, 0, app_secret);
+
+  report(base + "/app_key_chain_get_0", iterations, [&]() { chain.get(0); });
+
+  uint32_t generation = 0;
+  report(base + "/app_key_chain_get_seq", iterations, [&]() {
+    chain.get(generation);
+    generation += 1;
+  });
+}
+
+static void
+bench_tree(CipherSuite suite, uint32_t n_leaves, int iterations)
+{
+  auto base = suite_name(suite) + "/n=" + std::to_string(n_leaves);
+  auto secret_size = Digest(suite).output_size();
+
+  std::vector<bytes> secrets;
+  for (uint32_t i = 0; i < n_leaves; i += 1) {
+    secrets.push_back(random_bytes(secret_size));
+  }
+
+  RatchetTree tree(suite, secrets);
+  auto leaf_secret = random_bytes(secret_size);
+
+  report(base + "/tree_encrypt", iterations, [&]() {
+    tree.encrypt(LeafIndex{ 0 }, leaf_secret);
+  });
+
+  auto path = tree.encrypt(LeafIndex{ 0 }, leaf_secret);
+  report(base + "/tree_decrypt", iterations, [&]() {
+    tree.decrypt(LeafIndex{ 0 }, path);
+  });
+
+  // GroupState marshal + key schedule, as run once per handshake in
+  // State::handle
+  GroupState group_state(suite);
+  group_state.group_id = random_bytes(16);
+  group_state.tree = tree;
+  group_state.transcript_hash = random_bytes(secret_size);
+
+  auto init_secret = random_bytes(secret_size);
+  auto update_secret = random_bytes(secret_size);
+  report(base + "/derive_epoch_secrets", iterations, [&]() {
+    State::derive_epoch_secrets(suite, init_secret, update_secret, group_state);
+  });
+}
+
+static void
+bench_state_handle(CipherSuite suite, SignatureScheme scheme, int iterations)
+{
+  auto base = suite_name(suite);
+  auto secret_size = Digest(suite).output_size();
+
+  // Set up a two-member group via the standard negotiation flow
+  auto init_a = random_bytes(secret_size);
+  auto init_b = random_bytes(secret_size);
+  auto leaf_a = random_bytes(secret_size);
+  auto identity_a = SignaturePrivateKey::generate(scheme);
+  auto identity_b = SignaturePrivateKey::generate(scheme);
+  auto cred_a = Credential::basic(to_bytes("alice"), identity_a);
+  auto cred_b = Credential::basic(to_bytes("bob"), identity_b);
+
+  auto uik_b = UserInitKey{};
+  uik_b.add_init_key(DHPrivateKey::node_derive(suite, init_b).public_key());
+  uik_b.sign(identity_b, cred_b);
+
+  auto group_id = to_bytes("bench");
+  auto initial = State::negotiate(
+    group_id, { suite }, leaf_a, identity_a, cred_a, uik_b);
+  auto state_a = initial.first;
+
+  auto update = state_a.update(random_bytes(secret_size));
+  report(base + "/state_handle_update", iterations, [&]() {
+    state_a.handle(update);
+  });
+}
+
+int
+main(int argc, char* argv[])
+{
+  int iterations = 100;
+  bool large = false;
+  for (int i = 1; i < argc; i += 1) {
+    if (std::string(argv[i]) == "--large") {
+      large = true;
+    } else {
+      iterations = std::atoi(argv[i]);
+    }
+  }
+
+  std::vector<CipherSuite> suites{
+    CipherSuite::P256_SHA256_AES128GCM,
+    CipherSuite::P521_SHA512_AES256GCM,
+    CipherSuite::X25519_SHA256_AES128GCM,
+    CipherSuite::X448_SHA512_AES256GCM,
+  };
+
+  std::vector<SignatureScheme> schemes{
+    SignatureScheme::P256_SHA256,
+    SignatureScheme::P521_SHA512,
+    SignatureScheme::Ed25519,
+    SignatureScheme::Ed448,
+  };
+
+  std::vector<uint32_t> group_sizes{ 2, 32, 512 };
+  if (large) {
+    group_sizes.push_back(8192);
+    group_sizes.push_back(100000);
+  }
+
+  for (size_t i = 0; i < suites.size(); i += 1) {
+    auto suite = suites[i];
+
+    bench_hkdf(suite, iterations);
+    bench_app_key_chain(suite, iterations);
+    bench_state_handle(suite, schemes[i], iterations);
+
+    for (auto n : group_sizes) {
+      // Tree setup cost is quadratic in the leaf count, so only run
+      // the largest sizes with a reduced iteration count
+      auto iters = (n > 512) ? std::max(iterations / 10, 1) : iterations;
+      bench_tree(suite, n, iters);
+    }
+  }
+
+  return 0;
+}
@@ -2,8 +2,11 @@
 #include "session.h"
 #include "test_vectors.h"
 #include "tree_math.h"
+#include <algorithm>
 #include <fstream>
+#include <future>
 #include <iostream>
+#include <vector>
 
 TreeMathTestVectors
 generate_tree_math()
@@ -424,6 +427,12 @@ template<typename T>
 void
 write_test_vectors(const T& vectors)
 {
+  // The file contents are unchanged -- a single TLS marshal, which is
+  // what TestLoader expects -- but they go to disk in fixed-size
+  // chunks rather than one monolithic write, so the stream layer
+  // never needs a second full-size copy as the vector files grow
+  static const size_t chunk_size = 64 * 1024;
+
   auto marshaled = tls::marshal(vectors);
 
   std::ofstream file(T::file_name, std::ios::out | std::ios::binary);
@@ -432,8 +441,11 @@ write_test_vectors(const T& vectors)
                                 T::file_name);
   }
 
-  auto data = reinterpret_cast<const char*>(marshaled.data());
-  file.write(data, marshaled.size());
+  for (size_t pos = 0; pos < marshaled.size(); pos += chunk_size) {
+    auto len = std::min(chunk_size, marshaled.size() - pos);
+    auto data = reinterpret_cast<const char*>(marshaled.data() + pos);
+    file.write(data, len);
+  }
 }
 
 template<typename T>
@@ -474,39 +486,45 @@ verify_session_repro(const F& generator)
   // that should reproduce actually do.
 }
 
+// Generate one vector family, write it out, and check that it
+// reproduces.  Each family is independent of the others, so these can
+// run concurrently; the family's vectors are released as soon as its
+// file is written, instead of every family staying resident until the
+// end of the run.
+template<typename F, typename V>
+std::future<void>
+launch_family(const F& generator, const V& verifier)
+{
+  return std::async(std::launch::async, [generator, verifier] {
+    write_test_vectors(generator());
+    verifier(generator);
+  });
+}
+
 int
 main()
 {
-  TreeMathTestVectors tree_math = generate_tree_math();
-  write_test_vectors(tree_math);
-
-  ResolutionTestVectors resolution = generate_resolution();
-  write_test_vectors(resolution);
-
-  CryptoTestVectors crypto = generate_crypto();
-  write_test_vectors(crypto);
-
-  KeyScheduleTestVectors key_schedule = generate_key_schedule();
-  write_test_vectors(key_schedule);
-
-  AppKeyScheduleTestVectors app_key_schedule = generate_app_key_schedule();
-  write_test_vectors(app_key_schedule);
-
-  MessagesTestVectors messages = generate_messages();
-  write_test_vectors(messages);
-
-  BasicSessionTestVectors basic_session = generate_basic_session();
-  write_test_vectors(basic_session);
+  // The determinism flag is refcounted, so this outer lock keeps it
+  // on for the whole run while the families take and release their
+  // own locks on their own threads
+  test::DeterministicHPKE lock;
 
-  // Verify that the test vectors are reproducible (to the extent
-  // possible)
-  verify_reproducible(generate_tree_math);
-  verify_reproducible(generate_resolution);
-  verify_reproducible(generate_crypto);
-  verify_reproducible(generate_key_schedule);
-  verify_reproducible(generate_app_key_schedule);
-  verify_reproducible(generate_messages);
-  verify_session_repro(generate_basic_session);
+  auto repro = [](auto gen) { verify_reproducible(gen); };
+  auto session_repro = [](auto gen) { verify_session_repro(gen); };
+
+  std::vector<std::future<void>> families;
+  families.push_back(launch_family(generate_tree_math, repro));
+  families.push_back(launch_family(generate_resolution, repro));
+  families.push_back(launch_family(generate_crypto, repro));
+  families.push_back(launch_family(generate_key_schedule, repro));
+  families.push_back(launch_family(generate_app_key_schedule, repro));
+  families.push_back(launch_family(generate_messages, repro));
+  families.push_back(launch_family(generate_basic_session, session_repro));
+
+  // Join all the families, propagating any generation failure
+  for (auto& family : families) {
+    family.get();
+  }
 
   // Verify that the test vectors load
   try {
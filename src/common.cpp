@@ -4,6 +4,101 @@
 
 namespace mls {
 
+namespace {
+
+// Secrets are small (16-64 bytes) and short-lived, so recycled blocks
+// are kept on a per-thread freelist, bucketed by power-of-two size
+// class.  Thread-local state keeps locks off the allocation path.
+const size_t min_block_size = 16;
+const size_t max_block_size = 256;
+const size_t max_blocks_per_class = 64;
+const size_t n_size_classes = 5; // 16, 32, 64, 128, 256
+
+struct SecurePool
+{
+  std::vector<void*> free[n_size_classes];
+
+  ~SecurePool()
+  {
+    for (auto& list : free) {
+      for (auto* block : list) {
+        ::operator delete(block);
+      }
+    }
+  }
+};
+
+thread_local SecurePool secure_pool;
+
+size_t
+block_size(size_t size)
+{
+  auto block = min_block_size;
+  while (block < size) {
+    block <<= 1;
+  }
+  return block;
+}
+
+size_t
+class_index(size_t block)
+{
+  size_t index = 0;
+  while ((min_block_size << index) != block) {
+    index += 1;
+  }
+  return index;
+}
+
+} // namespace
+
+void
+zeroize(void* data, size_t size)
+{
+  auto ptr = static_cast<volatile uint8_t*>(data);
+  for (size_t i = 0; i < size; i += 1) {
+    ptr[i] = 0;
+  }
+}
+
+void*
+secure_allocate(size_t size)
+{
+  if (size > max_block_size) {
+    return ::operator new(size);
+  }
+
+  auto& list = secure_pool.free[class_index(block_size(size))];
+  if (!list.empty()) {
+    auto* block = list.back();
+    list.pop_back();
+    return block;
+  }
+
+  return ::operator new(block_size(size));
+}
+
+void
+secure_deallocate(void* data, size_t size)
+{
+  if (size > max_block_size) {
+    zeroize(data, size);
+    ::operator delete(data);
+    return;
+  }
+
+  auto block = block_size(size);
+  zeroize(data, block);
+
+  auto& list = secure_pool.free[class_index(block)];
+  if (list.size() < max_blocks_per_class) {
+    list.push_back(data);
+    return;
+  }
+
+  ::operator delete(data);
+}
+
 bytes
 to_bytes(const std::string& ascii)
 {
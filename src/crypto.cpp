@@ -1,5 +1,6 @@
 #include "crypto.h"
 #include "common.h"
+#include "metrics.h"
 #include "openssl/ecdh.h"
 #include "openssl/ecdsa.h"
 #include "openssl/err.h"
@@ -10,7 +11,16 @@
 #include "openssl/sha.h"
 #include "state.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <thread>
 
 namespace mls {
 
@@ -20,7 +30,7 @@ namespace mls {
 
 namespace test {
 
-int DeterministicHPKE::_refct = 0;
+std::atomic<int> DeterministicHPKE::_refct{ 0 };
 
 bool
 deterministic_signature_scheme(SignatureScheme scheme)
@@ -160,7 +170,8 @@ struct OpenSSLKey
   virtual bool can_derive() const = 0;
   virtual bool can_sign() const = 0;
 
-  virtual bytes marshal() const = 0;
+  virtual bytes marshal_raw() const = 0;
+  virtual bytes marshal_private() const = 0;
   virtual void generate() = 0;
   virtual void set_public(const bytes& data) = 0;
   virtual void set_private(const bytes& data) = 0;
@@ -168,6 +179,24 @@ struct OpenSSLKey
   virtual OpenSSLKey* dup() const = 0;
   virtual OpenSSLKey* dup_public() const = 0;
 
+  // The marshaled form is cached after the first extraction, since
+  // trees and init keys serialize the same unchanged keys over and
+  // over.  The key object is shared among copies of the owning
+  // PublicKey/PrivateKey, which may marshal from several threads at
+  // once, so the lazy fill runs under a once_flag; mutators
+  // repopulate the cache directly, and only run before the key is
+  // shared.
+  const bytes& marshal() const
+  {
+    std::call_once(_marshal_once, [this]() {
+      if (_marshal_cache.empty()) {
+        _marshal_cache = marshal_raw();
+      }
+    });
+
+    return _marshal_cache;
+  }
+
   // Defined below to make it easier to refer to the more specific
   // key types.
   static OpenSSLKey* create(OpenSSLKeyType type);
@@ -195,6 +224,10 @@ struct OpenSSLKey
   }
 
   typed_unique_ptr<EVP_PKEY> _key;
+
+protected:
+  mutable bytes _marshal_cache;
+  mutable std::once_flag _marshal_once;
 };
 
 ///
@@ -349,7 +382,7 @@ public:
     return false;
   }
 
-  bytes marshal() const override
+  bytes marshal_raw() const override
   {
     size_t raw_len;
     if (1 != EVP_PKEY_get_raw_public_key(_key.get(), nullptr, &raw_len)) {
@@ -365,6 +398,22 @@ public:
     return raw;
   }
 
+  bytes marshal_private() const override
+  {
+    size_t raw_len = 0;
+    if (1 != EVP_PKEY_get_raw_private_key(_key.get(), nullptr, &raw_len)) {
+      throw OpenSSLError::current();
+    }
+
+    bytes raw(raw_len);
+    auto data_ptr = raw.data();
+    if (1 != EVP_PKEY_get_raw_private_key(_key.get(), data_ptr, &raw_len)) {
+      throw OpenSSLError::current();
+    }
+
+    return raw;
+  }
+
   void generate() override { set_secret(random_bytes(secret_size())); }
 
   void set_public(const bytes& data) override
@@ -376,6 +425,7 @@ public:
     }
 
     _key.reset(pkey);
+    _marshal_cache = marshal_raw();
   }
 
   void set_private(const bytes& data) override
@@ -387,6 +437,7 @@ public:
     }
 
     _key.reset(pkey);
+    _marshal_cache = marshal_raw();
   }
 
   void set_secret(const bytes& data) override
@@ -501,7 +552,7 @@ public:
   bool can_derive() const override { return true; }
   bool can_sign() const override { return true; }
 
-  bytes marshal() const override
+  bytes marshal_raw() const override
   {
     auto pub = EVP_PKEY_get0_EC_KEY(_key.get());
 
@@ -521,6 +572,19 @@ public:
     return out;
   }
 
+  bytes marshal_private() const override
+  {
+    auto eckey = my_ec_key();
+    auto d = EC_KEY_get0_private_key(eckey);
+    if (d == nullptr) {
+      throw InvalidParameterError("marshal_private called on a public key");
+    }
+
+    bytes out(BN_num_bytes(d));
+    BN_bn2bin(d, out.data());
+    return out;
+  }
+
   void generate() override
   {
     auto eckey = make_typed_unique(new_ec_key());
@@ -615,6 +679,7 @@ private:
     EVP_PKEY_assign_EC_KEY(pkey, eckey);
 
     _key.reset(pkey);
+    _marshal_cache = marshal_raw();
   }
 
   const EC_KEY* my_ec_key() const { return EVP_PKEY_get0_EC_KEY(_key.get()); }
@@ -665,6 +730,99 @@ OpenSSLKey::derive(OpenSSLKeyType type, const bytes& data)
   return key.release();
 }
 
+///
+/// Thread-local context pools
+///
+/// Creating and freeing EVP contexts accounts for a measurable
+/// fraction of handshake CPU, so Digest and AESGCM check contexts
+/// out of a per-thread free list and return them on destruction,
+/// resetting instead of recreating.
+///
+
+namespace {
+
+const size_t max_ctx_pool_size = 16;
+
+struct MDCtxPool
+{
+  std::vector<EVP_MD_CTX*> free;
+
+  ~MDCtxPool()
+  {
+    for (auto* ctx : free) {
+      EVP_MD_CTX_free(ctx);
+    }
+  }
+
+  EVP_MD_CTX* get()
+  {
+    if (free.empty()) {
+      return EVP_MD_CTX_new();
+    }
+
+    auto ctx = free.back();
+    free.pop_back();
+    return ctx;
+  }
+
+  void put(EVP_MD_CTX* ctx)
+  {
+    if (ctx == nullptr) {
+      return;
+    }
+
+    if ((free.size() >= max_ctx_pool_size) || (1 != EVP_MD_CTX_reset(ctx))) {
+      EVP_MD_CTX_free(ctx);
+      return;
+    }
+
+    free.push_back(ctx);
+  }
+};
+
+struct CipherCtxPool
+{
+  std::vector<EVP_CIPHER_CTX*> free;
+
+  ~CipherCtxPool()
+  {
+    for (auto* ctx : free) {
+      EVP_CIPHER_CTX_free(ctx);
+    }
+  }
+
+  EVP_CIPHER_CTX* get()
+  {
+    if (free.empty()) {
+      return EVP_CIPHER_CTX_new();
+    }
+
+    auto ctx = free.back();
+    free.pop_back();
+    return ctx;
+  }
+
+  void put(EVP_CIPHER_CTX* ctx)
+  {
+    if (ctx == nullptr) {
+      return;
+    }
+
+    if ((free.size() >= max_ctx_pool_size) ||
+        (1 != EVP_CIPHER_CTX_reset(ctx))) {
+      EVP_CIPHER_CTX_free(ctx);
+      return;
+    }
+
+    free.push_back(ctx);
+  }
+};
+
+thread_local MDCtxPool md_ctx_pool;
+thread_local CipherCtxPool cipher_ctx_pool;
+
+} // namespace
+
 ///
 /// Digest
 ///
@@ -674,11 +832,14 @@ digest_type(CipherSuite suite)
 {
   switch (suite) {
     case CipherSuite::P256_SHA256_AES128GCM:
+      return CipherSuiteTraits<CipherSuite::P256_SHA256_AES128GCM>::digest_type;
     case CipherSuite::X25519_SHA256_AES128GCM:
-      return DigestType::SHA256;
+      return CipherSuiteTraits<
+        CipherSuite::X25519_SHA256_AES128GCM>::digest_type;
     case CipherSuite::P521_SHA512_AES256GCM:
+      return CipherSuiteTraits<CipherSuite::P521_SHA512_AES256GCM>::digest_type;
     case CipherSuite::X448_SHA512_AES256GCM:
-      return DigestType::SHA512;
+      return CipherSuiteTraits<CipherSuite::X448_SHA512_AES256GCM>::digest_type;
   }
 
   throw InvalidParameterError("Unknown ciphersuite");
@@ -696,7 +857,7 @@ ossl_digest_type(DigestType type)
 }
 
 Digest::Digest(DigestType type)
-  : _ctx(EVP_MD_CTX_new())
+  : _ctx(md_ctx_pool.get())
 {
   auto md = ossl_digest_type(type);
   _size = EVP_MD_size(md);
@@ -709,6 +870,11 @@ Digest::Digest(CipherSuite suite)
   : Digest(digest_type(suite))
 {}
 
+Digest::~Digest()
+{
+  md_ctx_pool.put(_ctx.release());
+}
+
 Digest&
 Digest::write(uint8_t byte)
 {
@@ -721,6 +887,7 @@ Digest::write(uint8_t byte)
 Digest&
 Digest::write(const bytes& data)
 {
+  metrics::count(metrics::Counter::digest_bytes, data.size());
   if (EVP_DigestUpdate(_ctx.get(), data.data(), data.size()) != 1) {
     throw OpenSSLError::current();
   }
@@ -823,7 +990,7 @@ hkdf_expand(CipherSuite suite,
             size_t size)
 {
   // Ensure that we need only one hash invocation
-  if (size > Digest(suite).output_size()) {
+  if (size > suite_digest_size(suite)) {
     throw InvalidParameterError("Size too big for hkdf_expand");
   }
 
@@ -834,19 +1001,14 @@ hkdf_expand(CipherSuite suite,
   return mac;
 }
 
-struct HKDFLabel
-{
-  uint16_t length;
-  tls::opaque<1> label;
-  tls::opaque<4> context;
-};
-
-tls::ostream&
-operator<<(tls::ostream& out, const HKDFLabel& obj)
-{
-  return out << obj.length << obj.label << obj.context;
-}
-
+// struct {
+//     uint16 length;
+//     opaque label<6..255>;
+//     opaque context<0..2^32-1>;
+// } HkdfLabel;
+//
+// The encoding is produced by HKDFLabelTemplate below, which
+// marshals the fixed fields once per (label, length) pair.
 bytes
 hkdf_expand_label(CipherSuite suite,
                   const bytes& secret,
@@ -854,13 +1016,60 @@ hkdf_expand_label(CipherSuite suite,
                   const bytes& context,
                   const size_t length)
 {
+  return HKDFLabelTemplate(label, length).expand(suite, secret, context);
+}
+
+///
+/// HKDFLabelTemplate
+///
+
+HKDFLabelTemplate::HKDFLabelTemplate(const std::string& label, size_t length)
+  : _length(length)
+{
+  // Everything up to the context field of the HKDFLabel struct is
+  // fixed for a given (label, length) pair
   auto mls_label = to_bytes(std::string("mls10 ") + label);
-  auto length16 = static_cast<uint16_t>(length);
-  HKDFLabel label_str{ length16, mls_label, context };
-  auto label_bytes = tls::marshal(label_str);
-  return hkdf_expand(suite, secret, label_bytes, length);
+  tls::ostream out;
+  out << static_cast<uint16_t>(_length) << tls::opaque<1>(mls_label);
+  _prefix = out.bytes();
 }
 
+bytes
+HKDFLabelTemplate::expand(CipherSuite suite,
+                          const bytes& secret,
+                          const bytes& context) const
+{
+  // Only the context splice and the HMAC remain per call
+  tls::ostream out;
+  out.reserve(_prefix.size() + 4 + context.size());
+  out.write_raw(_prefix);
+  out << uint32_t(context.size());
+  out.write_raw(context);
+  return hkdf_expand(suite, secret, out.bytes(), _length);
+}
+
+namespace {
+
+// The labels passed to derive_secret are a small static set, so their
+// templates are built once and reused.  The cache is thread-local to
+// keep locks off this path.
+const HKDFLabelTemplate&
+cached_label_template(const std::string& label, size_t length)
+{
+  thread_local std::map<std::pair<std::string, size_t>, HKDFLabelTemplate>
+    cache;
+
+  auto key = std::make_pair(label, length);
+  auto cached = cache.find(key);
+  if (cached == cache.end()) {
+    cached = cache.emplace(key, HKDFLabelTemplate(label, length)).first;
+  }
+
+  return cached->second;
+}
+
+} // namespace
+
 bytes
 derive_secret(CipherSuite suite,
               const bytes& secret,
@@ -868,8 +1077,8 @@ derive_secret(CipherSuite suite,
               const bytes& context)
 {
   auto context_hash = Digest(suite).write(context).digest();
-  auto size = Digest(suite).output_size();
-  return hkdf_expand_label(suite, secret, label, context_hash, size);
+  auto size = suite_digest_size(suite);
+  return cached_label_template(label, size).expand(suite, secret, context_hash);
 }
 
 ///
@@ -900,34 +1109,61 @@ AESGCM::AESGCM(const bytes& key, const bytes& nonce)
   _nonce = nonce;
 }
 
+AESGCM::~AESGCM()
+{
+  cipher_ctx_pool.put(_enc_ctx.release());
+  cipher_ctx_pool.put(_dec_ctx.release());
+}
+
 void
 AESGCM::set_aad(const bytes& aad)
 {
   _aad = aad;
 }
 
+void
+AESGCM::set_nonce(const bytes& nonce)
+{
+  if (nonce.size() != nonce_size) {
+    throw InvalidParameterError("Invalid AES-GCM nonce size");
+  }
+
+  _nonce = nonce;
+}
+
 bytes
 AESGCM::encrypt(const bytes& plaintext) const
 {
-  auto ctx = make_typed_unique(EVP_CIPHER_CTX_new());
-  if (ctx.get() == nullptr) {
-    throw OpenSSLError::current();
+  metrics::count(metrics::Counter::aes_gcm_encrypt);
+
+  // Load the key schedule on first use; later calls only reset the
+  // nonce, keeping the key schedule across a run of messages
+  if (_enc_ctx.get() == nullptr) {
+    _enc_ctx.reset(cipher_ctx_pool.get());
+    if (_enc_ctx.get() == nullptr) {
+      throw OpenSSLError::current();
+    }
+
+    if (1 != EVP_EncryptInit(_enc_ctx.get(), _cipher, _key.data(), nullptr)) {
+      throw OpenSSLError::current();
+    }
   }
 
-  if (1 != EVP_EncryptInit(ctx.get(), _cipher, _key.data(), _nonce.data())) {
+  auto ctx = _enc_ctx.get();
+  if (1 != EVP_EncryptInit(ctx, nullptr, nullptr, _nonce.data())) {
     throw OpenSSLError::current();
   }
 
   int outlen = 0;
   if (!_aad.empty()) {
-    if (1 != EVP_EncryptUpdate(
-               ctx.get(), nullptr, &outlen, _aad.data(), _aad.size())) {
+    if (1 !=
+        EVP_EncryptUpdate(ctx, nullptr, &outlen, _aad.data(), _aad.size())) {
       throw OpenSSLError::current();
     }
   }
 
   bytes ciphertext(plaintext.size());
-  if (1 != EVP_EncryptUpdate(ctx.get(),
+  if (1 != EVP_EncryptUpdate(ctx,
                              ciphertext.data(),
                              &outlen,
                              plaintext.data(),
@@ -937,13 +1173,13 @@ AESGCM::encrypt(const bytes& plaintext) const
 
   // Providing nullptr as an argument is safe here because this
   // function never writes with GCM; it only computes the tag
-  if (1 != EVP_EncryptFinal(ctx.get(), nullptr, &outlen)) {
+  if (1 != EVP_EncryptFinal(ctx, nullptr, &outlen)) {
     throw OpenSSLError::current();
   }
 
   bytes tag(tag_size);
-  if (1 != EVP_CIPHER_CTX_ctrl(
-             ctx.get(), EVP_CTRL_GCM_GET_TAG, tag_size, tag.data())) {
+  if (1 !=
+      EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, tag_size, tag.data())) {
     throw OpenSSLError::current();
   }
 
@@ -953,35 +1189,44 @@ AESGCM::encrypt(const bytes& plaintext) const
 bytes
 AESGCM::decrypt(const bytes& ciphertext) const
 {
+  metrics::count(metrics::Counter::aes_gcm_decrypt);
+
   if (ciphertext.size() < tag_size) {
     throw InvalidParameterError("AES-GCM ciphertext smaller than tag size");
   }
 
-  auto ctx = make_typed_unique(EVP_CIPHER_CTX_new());
-  if (ctx.get() == nullptr) {
-    throw OpenSSLError::current();
+  if (_dec_ctx.get() == nullptr) {
+    _dec_ctx.reset(cipher_ctx_pool.get());
+    if (_dec_ctx.get() == nullptr) {
+      throw OpenSSLError::current();
+    }
+
+    if (1 != EVP_DecryptInit(_dec_ctx.get(), _cipher, _key.data(), nullptr)) {
+      throw OpenSSLError::current();
+    }
   }
 
-  if (1 != EVP_DecryptInit(ctx.get(), _cipher, _key.data(), _nonce.data())) {
+  auto ctx = _dec_ctx.get();
+  if (1 != EVP_DecryptInit(ctx, nullptr, nullptr, _nonce.data())) {
     throw OpenSSLError::current();
   }
 
   bytes tag(ciphertext.end() - tag_size, ciphertext.end());
-  if (1 != EVP_CIPHER_CTX_ctrl(
-             ctx.get(), EVP_CTRL_GCM_SET_TAG, tag_size, tag.data())) {
+  if (1 !=
+      EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, tag_size, tag.data())) {
     throw OpenSSLError::current();
   }
 
   int out_size;
   if (!_aad.empty()) {
-    if (1 != EVP_DecryptUpdate(
-               ctx.get(), nullptr, &out_size, _aad.data(), _aad.size())) {
+    if (1 !=
+        EVP_DecryptUpdate(ctx, nullptr, &out_size, _aad.data(), _aad.size())) {
       throw OpenSSLError::current();
     }
   }
 
   bytes plaintext(ciphertext.size() - tag_size);
-  if (1 != EVP_DecryptUpdate(ctx.get(),
+  if (1 != EVP_DecryptUpdate(ctx,
                              plaintext.data(),
                              &out_size,
                              ciphertext.data(),
@@ -991,7 +1236,7 @@ AESGCM::decrypt(const bytes& ciphertext) const
 
   // Providing nullptr as an argument is safe here because this
   // function never writes with GCM; it only verifies the tag
-  if (1 != EVP_DecryptFinal(ctx.get(), nullptr, &out_size)) {
+  if (1 != EVP_DecryptFinal(ctx, nullptr, &out_size)) {
     throw InvalidParameterError("AES-GCM authentication failure");
   }
 
@@ -1001,16 +1246,7 @@ AESGCM::decrypt(const bytes& ciphertext) const
 size_t
 AESGCM::key_size(CipherSuite suite)
 {
-  switch (suite) {
-    case CipherSuite::P256_SHA256_AES128GCM:
-    case CipherSuite::X25519_SHA256_AES128GCM:
-      return key_size_128;
-    case CipherSuite::P521_SHA512_AES256GCM:
-    case CipherSuite::X448_SHA512_AES256GCM:
-      return key_size_256;
-  }
-
-  throw InvalidParameterError("Non-AESGCM ciphersuite");
+  return suite_key_size(suite);
 }
 
 ///
@@ -1032,7 +1268,7 @@ PublicKey::PublicKey(SignatureScheme scheme)
 PublicKey::PublicKey(const PublicKey& other)
   : CipherAware(other)
   , SignatureAware(other)
-  , _key(other._key->dup())
+  , _key(other._key)
 {}
 
 PublicKey::PublicKey(CipherSuite suite, const bytes& data)
@@ -1067,7 +1303,7 @@ PublicKey&
 PublicKey::operator=(const PublicKey& other)
 {
   if (&other != this) {
-    _key.reset(other._key->dup());
+    _key = other._key;
     _suite = other._suite;
     _scheme = other._scheme;
   }
@@ -1106,7 +1342,13 @@ PublicKey::to_bytes() const
 void
 PublicKey::reset(const bytes& data)
 {
-  _key->set_public(data);
+  // Install the new value in a fresh key, so that copies sharing the
+  // old key are unaffected
+  auto type = (_scheme == unknown_scheme) ? ossl_key_type(_suite)
+                                          : ossl_key_type(_scheme);
+  auto key = std::shared_ptr<OpenSSLKey>(OpenSSLKey::create(type));
+  key->set_public(data);
+  _key = std::move(key);
 }
 
 void
@@ -1138,7 +1380,7 @@ operator>>(tls::istream& in, PublicKey& obj)
 PrivateKey::PrivateKey(const PrivateKey& other)
   : CipherAware(other)
   , SignatureAware(other)
-  , _key(other._key->dup())
+  , _key(other._key)
   , _pub(type_preserving_dup(other._pub.get()))
 {}
 
@@ -1146,7 +1388,7 @@ PrivateKey&
 PrivateKey::operator=(const PrivateKey& other)
 {
   if (this != &other) {
-    _key.reset(other._key->dup());
+    _key = other._key;
     _pub = type_preserving_dup(other._pub.get());
     _suite = other._suite;
     _scheme = other._scheme;
@@ -1178,6 +1420,12 @@ PrivateKey::operator!=(const PrivateKey& other) const
   return !(*this == other);
 }
 
+bytes
+PrivateKey::to_bytes() const
+{
+  return _key->marshal_private();
+}
+
 std::unique_ptr<PublicKey>
 PrivateKey::type_preserving_dup(const PublicKey* pub) const
 {
@@ -1346,6 +1594,8 @@ setup_base(CipherSuite suite,
 HPKECiphertext
 DHPublicKey::encrypt(const bytes& plaintext) const
 {
+  metrics::count(metrics::Counter::hpke_encrypt);
+
   // SetupBaseI
   auto ephemeral = DHPrivateKey::generate(_suite);
   if (test::DeterministicHPKE::enabled()) {
@@ -1366,8 +1616,154 @@ DHPublicKey::encrypt(const bytes& plaintext) const
   return HPKECiphertext{ ephemeral.public_key(), content };
 }
 
+///
+/// DHKeyPool
+///
+
+namespace {
+
+struct DHKeyPoolState
+{
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::map<CipherSuite, size_t> depths;
+  std::map<CipherSuite, std::deque<DHPrivateKey>> keys;
+  std::thread worker;
+  bool running = false;
+
+  // Stop the worker if the process exits with the pool still enabled
+  ~DHKeyPoolState()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      running = false;
+    }
+
+    wake.notify_all();
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+};
+
+DHKeyPoolState&
+key_pool()
+{
+  static DHKeyPoolState state;
+  return state;
+}
+
+} // namespace
+
+void
+DHKeyPool::enable(CipherSuite suite, size_t depth)
+{
+  auto& pool = key_pool();
+
+  {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.depths[suite] = depth;
+
+    if (!pool.running) {
+      pool.running = true;
+      pool.worker = std::thread([]() {
+        auto& state = key_pool();
+        std::unique_lock<std::mutex> guard(state.mutex);
+        while (state.running) {
+          // Find a ciphersuite whose pool is below its target depth
+          std::optional<CipherSuite> refill;
+          for (const auto& entry : state.depths) {
+            if (state.keys[entry.first].size() < entry.second) {
+              refill = entry.first;
+              break;
+            }
+          }
+
+          if (!refill) {
+            state.wake.wait(guard);
+            continue;
+          }
+
+          // Run the keygen without holding the lock
+          guard.unlock();
+          auto key = DHPrivateKey::generate_fresh(*refill);
+          guard.lock();
+
+          if (state.running) {
+            state.keys.at(*refill).emplace_back(std::move(key));
+          }
+        }
+      });
+    }
+  }
+
+  pool.wake.notify_all();
+}
+
+void
+DHKeyPool::disable()
+{
+  auto& pool = key_pool();
+  std::thread worker;
+
+  {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if (!pool.running) {
+      return;
+    }
+
+    pool.running = false;
+    pool.depths.clear();
+    pool.keys.clear();
+    worker = std::move(pool.worker);
+  }
+
+  pool.wake.notify_all();
+  worker.join();
+}
+
+size_t
+DHKeyPool::available(CipherSuite suite)
+{
+  auto& pool = key_pool();
+  std::lock_guard<std::mutex> lock(pool.mutex);
+  auto entry = pool.keys.find(suite);
+  if (entry == pool.keys.end()) {
+    return 0;
+  }
+
+  return entry->second.size();
+}
+
+std::optional<DHPrivateKey>
+DHKeyPool::take(CipherSuite suite)
+{
+  auto& pool = key_pool();
+  std::lock_guard<std::mutex> lock(pool.mutex);
+  auto entry = pool.keys.find(suite);
+  if (entry == pool.keys.end() || entry->second.empty()) {
+    return std::nullopt;
+  }
+
+  auto key = std::move(entry->second.front());
+  entry->second.pop_front();
+  pool.wake.notify_all();
+  return key;
+}
+
 DHPrivateKey
 DHPrivateKey::generate(CipherSuite suite)
+{
+  auto pooled = DHKeyPool::take(suite);
+  if (pooled) {
+    return *pooled;
+  }
+
+  return generate_fresh(suite);
+}
+
+DHPrivateKey
+DHPrivateKey::generate_fresh(CipherSuite suite)
 {
   auto type = ossl_key_type(suite);
   return DHPrivateKey(suite, OpenSSLKey::generate(type));
@@ -1442,6 +1838,8 @@ DHPrivateKey::derive(const DHPublicKey& pub) const
 bytes
 DHPrivateKey::decrypt(const HPKECiphertext& ciphertext) const
 {
+  metrics::count(metrics::Counter::hpke_decrypt);
+
   // SetupBaseR
   auto enc = ciphertext.ephemeral.to_bytes();
   auto zz = derive(ciphertext.ephemeral);
@@ -1477,6 +1875,8 @@ DHPrivateKey::DHPrivateKey(CipherSuite suite, OpenSSLKey* key)
 bool
 SignaturePublicKey::verify(const bytes& message, const bytes& signature) const
 {
+  metrics::count(metrics::Counter::signature_verify);
+
   if (!_key->can_sign()) {
     throw InvalidParameterError("Inappropriate key for verify");
   }
@@ -1500,6 +1900,56 @@ SignaturePublicKey::verify(const bytes& message, const bytes& signature) const
   return rv == 1;
 }
 
+bool
+verify_batch(const std::vector<SignatureBatchItem>& items)
+{
+  // Below this size, thread startup costs more than it saves
+  static const size_t parallel_threshold = 8;
+
+  if (items.size() < parallel_threshold) {
+    for (const auto& item : items) {
+      if (!item.key.verify(item.message, item.signature)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  auto n_workers = size_t(std::thread::hardware_concurrency());
+  if (n_workers == 0) {
+    n_workers = 1;
+  }
+  n_workers = std::min(n_workers, items.size());
+
+  std::atomic<bool> ok{ true };
+  auto chunk = (items.size() + n_workers - 1) / n_workers;
+  std::vector<std::future<void>> futures;
+  futures.reserve(n_workers);
+  for (size_t w = 0; w < n_workers; w += 1) {
+    auto begin = w * chunk;
+    auto end = std::min(items.size(), begin + chunk);
+    if (begin >= end) {
+      break;
+    }
+
+    futures.emplace_back(
+      std::async(std::launch::async, [&items, &ok, begin, end]() {
+        for (size_t i = begin; i < end && ok; i += 1) {
+          if (!items[i].key.verify(items[i].message, items[i].signature)) {
+            ok = false;
+          }
+        }
+      }));
+  }
+
+  for (auto& future : futures) {
+    future.wait();
+  }
+
+  return ok;
+}
+
 SignaturePrivateKey
 SignaturePrivateKey::generate(SignatureScheme scheme)
 {
@@ -1524,6 +1974,8 @@ SignaturePrivateKey::derive(SignatureScheme scheme, const bytes& secret)
 bytes
 SignaturePrivateKey::sign(const bytes& message) const
 {
+  metrics::count(metrics::Counter::signature_sign);
+
   if (!_key->can_sign()) {
     throw InvalidParameterError("Inappropriate key for sign");
   }
@@ -2,6 +2,7 @@
 
 #include <array>
 #include <iomanip>
+#include <memory>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
@@ -47,7 +48,12 @@ operator<<(std::ostream& out, const std::optional<T>& opt)
 /// Byte strings and serialization
 ///
 
-typedef std::vector<uint8_t> bytes;
+// The basic byte string type, with an opt-in allocator parameter for
+// callers that need special handling of the underlying storage
+template<typename Alloc = std::allocator<uint8_t>>
+using basic_bytes = std::vector<uint8_t, Alloc>;
+
+typedef basic_bytes<> bytes;
 
 bytes
 to_bytes(const std::string& ascii);
@@ -69,6 +75,84 @@ operator<<(std::ostream& out, const bytes& data);
 
 typedef uint32_t epoch_t;
 
+///
+/// Secure storage for secret material
+///
+
+// Zero a buffer in a way that the optimizer is not allowed to elide
+void
+zeroize(void* data, size_t size);
+
+template<typename Alloc>
+void
+zeroize(basic_bytes<Alloc>& data)
+{
+  zeroize(data.data(), data.size());
+}
+
+// Allocation hooks used by SecureAllocator.  Small blocks from
+// secure_allocate are recycled through a per-thread freelist rather
+// than going back to the heap, and every block is zeroized when it is
+// released, so freed secrets never linger in memory.
+void*
+secure_allocate(size_t size);
+
+void
+secure_deallocate(void* data, size_t size);
+
+template<typename T>
+class SecureAllocator
+{
+public:
+  typedef T value_type;
+
+  SecureAllocator() = default;
+
+  template<typename U>
+  SecureAllocator(const SecureAllocator<U>& other)
+  {}
+
+  T* allocate(size_t n)
+  {
+    return static_cast<T*>(secure_allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* data, size_t n) { secure_deallocate(data, n * sizeof(T)); }
+};
+
+template<typename T, typename U>
+bool
+operator==(const SecureAllocator<T>& lhs, const SecureAllocator<U>& rhs)
+{
+  return true;
+}
+
+template<typename T, typename U>
+bool
+operator!=(const SecureAllocator<T>& lhs, const SecureAllocator<U>& rhs)
+{
+  return false;
+}
+
+// A byte string for secret material: pooled allocation for the small,
+// short-lived buffers of the key schedule, with guaranteed
+// zero-on-release
+typedef basic_bytes<SecureAllocator<uint8_t>> secure_bytes;
+
+// Copies across the boundary between secret-holding fields and the
+// byte-oriented crypto and TLS interfaces, which take ordinary bytes
+inline secure_bytes
+to_secure(const bytes& data)
+{
+  return secure_bytes(data.begin(), data.end());
+}
+
+inline bytes
+from_secure(const secure_bytes& data)
+{
+  return bytes(data.begin(), data.end());
+}
+
 ///
 /// Error types
 ///
@@ -4,6 +4,8 @@
 #include "openssl/ec.h"
 #include "openssl/evp.h"
 #include "tls_syntax.h"
+#include <atomic>
+#include <memory>
 #include <stdexcept>
 #include <vector>
 
@@ -73,7 +75,8 @@ namespace test {
 // that the determinism always gets turned off.  To avoid conflicts
 // between multiple requests for determinism, determinism is turned
 // off when the last object in the stack is destroyed; it's
-// basically a ref-counted bool.
+// basically a ref-counted bool.  The count is atomic so that locks
+// can be taken and released on several threads at once.
 class DeterministicHPKE
 {
 public:
@@ -82,7 +85,7 @@ public:
   static bool enabled() { return _refct > 0; }
 
 private:
-  static int _refct;
+  static std::atomic<int> _refct;
 };
 
 bool
@@ -149,6 +152,11 @@ class Digest
 public:
   Digest(DigestType type);
   Digest(CipherSuite suite);
+
+  // Contexts are checked out of a per-thread pool on construction
+  // and returned on destruction
+  ~Digest();
+
   Digest& write(uint8_t byte);
   Digest& write(const bytes& data);
   bytes digest();
@@ -190,6 +198,25 @@ derive_secret(CipherSuite suite,
               const std::string& label,
               const bytes& context);
 
+// A precompiled HKDF label for a fixed (label, length) pair.  The
+// length and "mls10 "-prefixed label are marshaled once at
+// construction, so that repeated expansions under the key schedule's
+// handful of static labels splice in only the context before running
+// the HMAC.
+class HKDFLabelTemplate
+{
+public:
+  HKDFLabelTemplate(const std::string& label, size_t length);
+
+  bytes expand(CipherSuite suite,
+               const bytes& secret,
+               const bytes& context) const;
+
+private:
+  size_t _length;
+  bytes _prefix;
+};
+
 class AESGCM
 {
 public:
@@ -200,8 +227,14 @@ public:
   AESGCM& operator=(AESGCM&& other) = delete;
 
   AESGCM(const bytes& key, const bytes& nonce);
+  ~AESGCM();
 
   void set_aad(const bytes& aad);
+
+  // Change the nonce while keeping the AES key schedule loaded, for
+  // senders encrypting a run of messages under the same key
+  void set_nonce(const bytes& nonce);
+
   bytes encrypt(const bytes& plaintext) const;
   bytes decrypt(const bytes& ciphertext) const;
 
@@ -221,8 +254,108 @@ private:
   // This raw pointer only ever references memory managed by
   // OpenSSL, so it doesn't need to be scoped.
   const EVP_CIPHER* _cipher;
+
+  // Lazily initialized contexts with the key schedule loaded, reused
+  // across calls until the key changes (which it never does for a
+  // given object)
+  mutable typed_unique_ptr<EVP_CIPHER_CTX> _enc_ctx;
+  mutable typed_unique_ptr<EVP_CIPHER_CTX> _dec_ctx;
+};
+
+// Compile-time descriptions of the ciphersuites, for callers that
+// pin their suite at build time (single-suite deployments).  These
+// expose the digest/key/nonce geometry as constants and a fixed-size
+// secret type, so suite-generic code can avoid both the per-call
+// suite switches and the heap allocation behind a dynamically sized
+// `bytes` secret.  The runtime accessors below are defined in terms
+// of the traits, so the two cannot drift apart.
+template<CipherSuite suite>
+struct CipherSuiteTraits;
+
+template<>
+struct CipherSuiteTraits<CipherSuite::P256_SHA256_AES128GCM>
+{
+  static constexpr DigestType digest_type = DigestType::SHA256;
+  static constexpr size_t digest_size = 32;
+  static constexpr size_t key_size = AESGCM::key_size_128;
+  static constexpr size_t nonce_size = AESGCM::nonce_size;
+  typedef std::array<uint8_t, digest_size> secret_type;
+};
+
+template<>
+struct CipherSuiteTraits<CipherSuite::X25519_SHA256_AES128GCM>
+{
+  static constexpr DigestType digest_type = DigestType::SHA256;
+  static constexpr size_t digest_size = 32;
+  static constexpr size_t key_size = AESGCM::key_size_128;
+  static constexpr size_t nonce_size = AESGCM::nonce_size;
+  typedef std::array<uint8_t, digest_size> secret_type;
 };
 
+template<>
+struct CipherSuiteTraits<CipherSuite::P521_SHA512_AES256GCM>
+{
+  static constexpr DigestType digest_type = DigestType::SHA512;
+  static constexpr size_t digest_size = 64;
+  static constexpr size_t key_size = AESGCM::key_size_256;
+  static constexpr size_t nonce_size = AESGCM::nonce_size;
+  typedef std::array<uint8_t, digest_size> secret_type;
+};
+
+template<>
+struct CipherSuiteTraits<CipherSuite::X448_SHA512_AES256GCM>
+{
+  static constexpr DigestType digest_type = DigestType::SHA512;
+  static constexpr size_t digest_size = 64;
+  static constexpr size_t key_size = AESGCM::key_size_256;
+  static constexpr size_t nonce_size = AESGCM::nonce_size;
+  typedef std::array<uint8_t, digest_size> secret_type;
+};
+
+// Runtime bridges to the traits.  Being constexpr, these fold to a
+// constant when the suite is known at compile time, and they avoid
+// constructing a Digest just to ask for its output size.
+constexpr size_t
+suite_digest_size(CipherSuite suite)
+{
+  switch (suite) {
+    case CipherSuite::P256_SHA256_AES128GCM:
+      return CipherSuiteTraits<CipherSuite::P256_SHA256_AES128GCM>::digest_size;
+    case CipherSuite::X25519_SHA256_AES128GCM:
+      return CipherSuiteTraits<
+        CipherSuite::X25519_SHA256_AES128GCM>::digest_size;
+    case CipherSuite::P521_SHA512_AES256GCM:
+      return CipherSuiteTraits<CipherSuite::P521_SHA512_AES256GCM>::digest_size;
+    case CipherSuite::X448_SHA512_AES256GCM:
+      return CipherSuiteTraits<CipherSuite::X448_SHA512_AES256GCM>::digest_size;
+  }
+
+  throw InvalidParameterError("Unknown ciphersuite");
+}
+
+constexpr size_t
+suite_key_size(CipherSuite suite)
+{
+  switch (suite) {
+    case CipherSuite::P256_SHA256_AES128GCM:
+      return CipherSuiteTraits<CipherSuite::P256_SHA256_AES128GCM>::key_size;
+    case CipherSuite::X25519_SHA256_AES128GCM:
+      return CipherSuiteTraits<CipherSuite::X25519_SHA256_AES128GCM>::key_size;
+    case CipherSuite::P521_SHA512_AES256GCM:
+      return CipherSuiteTraits<CipherSuite::P521_SHA512_AES256GCM>::key_size;
+    case CipherSuite::X448_SHA512_AES256GCM:
+      return CipherSuiteTraits<CipherSuite::X448_SHA512_AES256GCM>::key_size;
+  }
+
+  throw InvalidParameterError("Unknown ciphersuite");
+}
+
+constexpr size_t
+suite_nonce_size(CipherSuite /* suite */)
+{
+  return AESGCM::nonce_size;
+}
+
 // Generic PublicKey and PrivateKey structs, which are specialized
 // to DH and Signature below
 
@@ -252,7 +385,11 @@ public:
   void reset(OpenSSLKey* key);
 
 protected:
-  typed_unique_ptr<OpenSSLKey> _key;
+  // The underlying key is shared among copies of this object, since
+  // copying an EVP key is expensive and the tree/roster copy keys
+  // around liberally.  Mutations install a fresh key rather than
+  // modifying the shared one.
+  std::shared_ptr<OpenSSLKey> _key;
 
   friend tls::ostream& operator<<(tls::ostream& out, const PublicKey& obj);
   friend tls::istream& operator>>(tls::istream& in, PublicKey& obj);
@@ -271,8 +408,14 @@ public:
   bool operator==(const PrivateKey& other) const;
   bool operator!=(const PrivateKey& other) const;
 
+  // The raw private key, for snapshot persistence.  The result is
+  // secret key material; callers are responsible for protecting it.
+  bytes to_bytes() const;
+
 protected:
-  typed_unique_ptr<OpenSSLKey> _key;
+  // Shared among copies, like PublicKey::_key; private keys are
+  // never mutated after construction
+  std::shared_ptr<OpenSSLKey> _key;
   std::unique_ptr<PublicKey> _pub;
 
   std::unique_ptr<PublicKey> type_preserving_dup(const PublicKey* pub) const;
@@ -311,6 +454,34 @@ public:
 
 private:
   DHPrivateKey(CipherSuite suite, OpenSSLKey* key);
+
+  // Always runs a keygen, bypassing the pool; used by the pool's
+  // refill thread
+  static DHPrivateKey generate_fresh(CipherSuite suite);
+  friend class DHKeyPool;
+};
+
+// A pool of pregenerated DH keypairs, refilled by a background thread
+// while the caller is idle.  Once enabled for a ciphersuite,
+// DHPrivateKey::generate draws from the pool instead of running a
+// fresh keygen on the critical path; if the pool runs dry, generate
+// falls back to a synchronous keygen.
+class DHKeyPool
+{
+public:
+  // Start the refill thread (if needed) and pregenerate up to `depth`
+  // keys for the given ciphersuite
+  static void enable(CipherSuite suite, size_t depth);
+
+  // Stop the refill thread and discard all pooled keys
+  static void disable();
+
+  // Number of pregenerated keys currently on hand
+  static size_t available(CipherSuite suite);
+
+private:
+  friend class DHPrivateKey;
+  static std::optional<DHPrivateKey> take(CipherSuite suite);
 };
 
 // Signature specialization
@@ -324,6 +495,22 @@ private:
   friend class SignaturePrivateKey;
 };
 
+// One (key, message, signature) tuple in a verification batch
+struct SignatureBatchItem
+{
+  SignaturePublicKey key;
+  bytes message;
+  bytes signature;
+};
+
+// Verify a batch of detached signatures, possibly under different
+// keys and schemes.  OpenSSL exposes no true batch-verification
+// entry point, so the savings come from spreading the independent
+// verifications across threads; small batches fall back to the
+// serial path.
+bool
+verify_batch(const std::vector<SignatureBatchItem>& items);
+
 class SignaturePrivateKey : public PrivateKey
 {
 public:
@@ -139,6 +139,19 @@ struct WelcomeInfo : public CipherAware
   {}
 
   bytes hash(CipherSuite suite) const;
+
+  // Compact transport encodings.  The canonical TLS encoding below is
+  // unchanged -- it still defines hash() -- but a Welcome can carry
+  // one of these instead, cutting the dominant onboarding cost for a
+  // large group: shipping the full tree and roster to every joiner.
+  // The delta form encodes only what changed relative to a prior
+  // published WelcomeInfo snapshot, so a mass-join event can transmit
+  // the tree once plus small diffs.
+  bytes compact() const;
+  bytes compact_delta(const WelcomeInfo& prior) const;
+  static WelcomeInfo decompact(CipherSuite suite, const bytes& data);
+  static WelcomeInfo decompact_delta(const WelcomeInfo& prior,
+                                     const bytes& data);
 };
 
 bool
@@ -164,6 +177,13 @@ struct Welcome
   {}
 
   Welcome(const bytes& id, const DHPublicKey& pub, const WelcomeInfo& info);
+
+  // As above, but carries the compact encoding of the WelcomeInfo;
+  // decrypt() detects which encoding is present
+  static Welcome with_compact_info(const bytes& id,
+                                   const DHPublicKey& pub,
+                                   const WelcomeInfo& info);
+
   WelcomeInfo decrypt(const DHPrivateKey& priv) const;
 };
 
@@ -180,6 +200,7 @@ enum class GroupOperationType : uint8_t
   add = 1,
   update = 2,
   remove = 3,
+  bulk_add = 4,
 };
 
 tls::ostream&
@@ -276,6 +297,41 @@ operator<<(tls::ostream& out, const Remove& obj);
 tls::istream&
 operator>>(tls::istream& in, Remove& obj);
 
+// struct {
+//     uint32 index;
+//     UserInitKey init_keys<0..2^32-1>;
+//     opaque welcome_info_hash<0..255>;
+// } BulkAdd;
+//
+// The new members occupy consecutive leaves starting at `index`, in
+// the order their init keys appear.
+struct BulkAdd
+{
+public:
+  LeafIndex index;
+  tls::vector<UserInitKey, 4> init_keys;
+  tls::opaque<1> welcome_info_hash;
+
+  BulkAdd() {}
+
+  BulkAdd(LeafIndex index,
+          const std::vector<UserInitKey>& init_keys,
+          bytes welcome_info_hash)
+    : index(index)
+    , init_keys(init_keys)
+    , welcome_info_hash(std::move(welcome_info_hash))
+  {}
+
+  static const GroupOperationType type;
+};
+
+bool
+operator==(const BulkAdd& lhs, const BulkAdd& rhs);
+tls::ostream&
+operator<<(tls::ostream& out, const BulkAdd& obj);
+tls::istream&
+operator>>(tls::istream& in, BulkAdd& obj);
+
 // Container class for all operations
 //
 // struct {
@@ -299,12 +355,14 @@ struct GroupOperation : public CipherAware
   Add add;
   Update update;
   Remove remove;
+  BulkAdd bulk_add;
 
   GroupOperation()
     : CipherAware(DUMMY_CIPHERSUITE)
     , add()
     , update(DUMMY_CIPHERSUITE)
     , remove(DUMMY_CIPHERSUITE)
+    , bulk_add()
   {}
 
   GroupOperation(CipherSuite suite)
@@ -312,6 +370,7 @@ struct GroupOperation : public CipherAware
     , add()
     , update(suite)
     , remove(suite)
+    , bulk_add()
   {}
 
   GroupOperation(const Add& add)
@@ -320,6 +379,7 @@ struct GroupOperation : public CipherAware
     , add(add)
     , update(DUMMY_CIPHERSUITE)
     , remove(DUMMY_CIPHERSUITE)
+    , bulk_add()
   {}
 
   GroupOperation(const Update& update)
@@ -328,7 +388,7 @@ struct GroupOperation : public CipherAware
     , add()
     , update(update)
     , remove(update.cipher_suite())
-
+    , bulk_add()
   {}
 
   GroupOperation(const Remove& remove)
@@ -337,6 +397,16 @@ struct GroupOperation : public CipherAware
     , add()
     , update(remove.cipher_suite())
     , remove(remove)
+    , bulk_add()
+  {}
+
+  GroupOperation(const BulkAdd& bulk_add)
+    : CipherAware(DUMMY_CIPHERSUITE)
+    , type(bulk_add.type)
+    , add()
+    , update(DUMMY_CIPHERSUITE)
+    , remove(DUMMY_CIPHERSUITE)
+    , bulk_add(bulk_add)
   {}
 };
 
@@ -392,4 +462,19 @@ operator<<(tls::ostream& out, const Handshake& obj);
 tls::istream&
 operator>>(tls::istream& in, Handshake& obj);
 
+// The routing-relevant fields at the front of a serialized
+// Handshake.  peek() decodes only these fields, skipping the embedded
+// operation via its length prefixes, so relays can route and order
+// messages without unmarshaling the payload -- and without any heap
+// allocation.
+struct HandshakeHeader
+{
+  epoch_t prior_epoch;
+  GroupOperationType operation_type;
+  LeafIndex signer_index;
+
+  static HandshakeHeader peek(const uint8_t* data, size_t size);
+  static HandshakeHeader peek(const bytes& data);
+};
+
 } // namespace mls
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+// Lightweight instrumentation for the library's hot paths.  Counters
+// are lock-free atomics and timers record into fixed-size latency
+// histograms, so the hooks are cheap enough to leave on in
+// production.  When MLS_METRICS is not defined (CMake option
+// MLS_METRICS, on by default), the hooks compile away entirely.
+//
+// This header depends only on the standard library, so that the
+// TLS-generic syntax layer can use it without picking up the rest of
+// the MLS headers.
+
+namespace mls {
+namespace metrics {
+
+// Each enumerator must have a matching entry in the name tables in
+// metrics.cpp; the max sentinel must stay last.
+enum struct Counter : uint8_t
+{
+  hpke_encrypt,
+  hpke_decrypt,
+  signature_sign,
+  signature_verify,
+  aes_gcm_encrypt,
+  aes_gcm_decrypt,
+  digest_bytes,
+  marshal_bytes,
+  handshakes_handled,
+  max,
+};
+
+enum struct Timer : uint8_t
+{
+  handshake_handle,
+  tree_encrypt,
+  tree_decrypt,
+  max,
+};
+
+// Latency histogram with power-of-two buckets: bucket 0 counts
+// sub-microsecond samples, bucket i counts samples in [2^(i-1), 2^i)
+// microseconds, and the last bucket catches everything longer.
+struct Histogram
+{
+  static const size_t n_buckets = 20;
+  uint64_t count = 0;
+  uint64_t total_us = 0;
+  std::array<uint64_t, n_buckets> buckets = {};
+};
+
+// A copy of all metrics, keyed by name, for a polling agent to
+// export.  Counters are read individually with relaxed ordering, so
+// a snapshot taken concurrently with updates is approximate.
+struct Snapshot
+{
+  std::map<std::string, uint64_t> counters;
+  std::map<std::string, Histogram> timers;
+};
+
+Snapshot
+snapshot();
+
+void
+reset();
+
+#ifdef MLS_METRICS
+
+void
+count(Counter counter, uint64_t n = 1);
+
+void
+record_us(Timer timer, uint64_t us);
+
+// Records the lifetime of the enclosing scope into a timer histogram
+class ScopedTimer
+{
+public:
+  ScopedTimer(Timer timer)
+    : _timer(timer)
+    , _start(std::chrono::steady_clock::now())
+  {}
+
+  ~ScopedTimer()
+  {
+    auto elapsed = std::chrono::steady_clock::now() - _start;
+    auto us =
+      std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    record_us(_timer, uint64_t(us));
+  }
+
+private:
+  Timer _timer;
+  std::chrono::steady_clock::time_point _start;
+};
+
+#else
+
+inline void
+count(Counter counter, uint64_t n = 1)
+{}
+
+inline void
+record_us(Timer timer, uint64_t us)
+{}
+
+class ScopedTimer
+{
+public:
+  ScopedTimer(Timer timer) {}
+};
+
+#endif // MLS_METRICS
+
+} // namespace metrics
+} // namespace mls
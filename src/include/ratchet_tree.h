@@ -5,7 +5,9 @@
 #include "tls_syntax.h"
 #include "tree_math.h"
 #include <iosfwd>
+#include <map>
 #include <optional>
+#include <set>
 
 namespace mls {
 
@@ -21,14 +23,16 @@ public:
   RatchetTreeNode(const DHPublicKey& pub);
 
   bool public_equal(const RatchetTreeNode& other) const;
-  const std::optional<bytes>& secret() const;
+  const std::optional<secure_bytes>& secret() const;
   const std::optional<DHPrivateKey>& private_key() const;
   const DHPublicKey& public_key() const;
 
   void merge(const RatchetTreeNode& other);
 
 private:
-  std::optional<bytes> _secret;
+  // Node secrets are resident for as long as the node is, so they
+  // live in zeroizing storage
+  std::optional<secure_bytes> _secret;
   std::optional<DHPrivateKey> _priv;
   DHPublicKey _pub;
 
@@ -79,15 +83,80 @@ struct RatchetTreeNodeVector
   const OptionalRatchetTreeNode& operator[](const NodeIndex index) const;
 };
 
+// Node storage for RatchetTree, in one of two layouts:
+//
+// * Dense (the default): all 2n-1 slots are stored contiguously,
+//   blanks included.
+// * Sparse: only populated nodes are stored, keyed by node index.
+//   In blank-heavy trees (large groups after many removals), memory
+//   scales with the number of populated nodes, and blanking or
+//   truncating actually releases the nodes' storage.
+//
+// Both layouts marshal to the same dense wire format.
+class RatchetTreeNodes
+{
+public:
+  RatchetTreeNodes(CipherSuite suite, bool sparse);
+
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+
+  // Read access; absent nodes read as blank
+  const OptionalRatchetTreeNode& operator[](uint32_t index) const;
+  const OptionalRatchetTreeNode& operator[](NodeIndex index) const;
+
+  void set(NodeIndex index, const RatchetTreeNode& node);
+  void merge(NodeIndex index, const RatchetTreeNode& node);
+  void blank(NodeIndex index);
+  void append_blank();
+  void append(const RatchetTreeNode& node);
+  void resize(size_t size);
+
+  // The indices of the nodes that currently hold a private key,
+  // maintained as the tree is mutated.  This is what makes invariant
+  // checking O(log n) instead of a full-tree scan.
+  const std::set<uint32_t>& private_key_holders() const
+  {
+    return _priv_nodes;
+  }
+
+private:
+  CipherSuite _suite;
+  bool _sparse;
+  size_t _size;
+
+  std::set<uint32_t> _priv_nodes;
+
+  // Dense layout
+  RatchetTreeNodeVector _vec;
+
+  // Sparse layout
+  std::map<uint32_t, OptionalRatchetTreeNode> _map;
+  OptionalRatchetTreeNode _blank;
+
+  // Cache of per-node encodings, invalidated only for nodes touched
+  // by a mutation.  Marshaling the tree (which the key schedule does
+  // on every epoch change) then only re-encodes the nodes that
+  // changed since the last epoch, instead of every key in the tree.
+  mutable std::map<uint32_t, bytes> _enc_cache;
+  const bytes& node_encoding(uint32_t index) const;
+
+  friend tls::ostream& operator<<(tls::ostream& out,
+                                  const RatchetTreeNodes& obj);
+  friend tls::istream& operator>>(tls::istream& in, RatchetTreeNodes& obj);
+};
+
 struct RatchetNode;
 struct DirectPath;
 
 class RatchetTree : public CipherAware
 {
 public:
-  RatchetTree(CipherSuite suite);
-  RatchetTree(CipherSuite suite, const bytes& secret);
-  RatchetTree(CipherSuite suite, const std::vector<bytes>& secrets);
+  RatchetTree(CipherSuite suite, bool sparse = false);
+  RatchetTree(CipherSuite suite, const bytes& secret, bool sparse = false);
+  RatchetTree(CipherSuite suite,
+              const std::vector<bytes>& secrets,
+              bool sparse = false);
 
   struct MergeInfo
   {
@@ -95,6 +164,11 @@ public:
     std::vector<bytes> secrets;
   };
 
+  // Run the independent public-key operations in encrypt/decrypt
+  // (HPKE fan-out and node key derivation) across threads, so that
+  // Update latency scales with cores rather than tree depth
+  void set_parallel(bool enabled);
+
   DirectPath encrypt(LeafIndex from, const bytes& leaf) const;
   MergeInfo decrypt(LeafIndex from, const DirectPath& path) const;
   void merge_path(LeafIndex from, const MergeInfo& info);
@@ -107,14 +181,43 @@ public:
   LeafCount leaf_span() const;
   void truncate(LeafCount leaves);
 
+  // Compact transport encoding: a presence bitmap plus the populated
+  // nodes' public keys packed back-to-back, so a run of blank nodes
+  // costs one bit per node instead of a per-node optional encoding.
+  // This is a transport format only; the canonical TLS encoding
+  // below is unchanged.
+  bytes compact() const;
+  static RatchetTree decompact(CipherSuite suite, const bytes& data);
+
+  // Delta encoding against a prior snapshot of the same tree: only
+  // the nodes that changed relative to the prior are included
+  bytes compact_delta(const RatchetTree& prior) const;
+  static RatchetTree decompact_delta(const RatchetTree& prior,
+                                     const bytes& data);
+
+  // The private keys this tree holds, keyed by node index.  The TLS
+  // encodings above carry public keys only, so snapshot persistence
+  // saves and reinstalls these separately.  The returned values are
+  // secret key material; callers are responsible for protecting it.
+  std::map<uint32_t, bytes> dump_private_keys() const;
+  void install_private_keys(const std::map<uint32_t, bytes>& keys);
+
   uint32_t size() const;
   bool occupied(LeafIndex index) const;
   bytes root_secret() const;
+
+  // Verify that this tree holds private keys for the direct path of
+  // this leaf and nothing else.  Checks only the direct path against
+  // the tracked set of private-key holders; debug builds cross-check
+  // against an exhaustive scan.
   bool check_invariant(LeafIndex from) const;
 
 private:
-  RatchetTreeNodeVector _nodes;
+  RatchetTreeNodes _nodes;
   size_t _secret_size;
+  bool _parallel = false;
+
+  bool scan_invariant(LeafIndex from) const;
 
   NodeCount node_size() const;
   RatchetTreeNode new_node(const bytes& path_secret) const;
@@ -4,6 +4,8 @@
 #include "crypto.h"
 #include "tls_syntax.h"
 #include <iosfwd>
+#include <map>
+#include <mutex>
 
 #define DUMMY_SIG_SCHEME SignatureScheme::P256_SHA256
 
@@ -39,12 +41,21 @@ struct AbstractCredential
 class BasicCredential : public AbstractCredential
 {
 public:
-  BasicCredential()
-    : _public_key(DUMMY_SIG_SCHEME)
+  BasicCredential() = default;
+
+  // The once_flag below is not copyable, so copies get a fresh one;
+  // public_key() re-checks the optional under it
+  BasicCredential(const BasicCredential& other)
+    : _identity(other._identity)
+    , _scheme(other._scheme)
+    , _key_data(other._key_data)
+    , _public_key(other._public_key)
   {}
 
   BasicCredential(const bytes& identity, const SignaturePublicKey& public_key)
     : _identity(identity)
+    , _scheme(public_key.signature_scheme())
+    , _key_data(public_key.to_bytes())
     , _public_key(public_key)
   {}
 
@@ -57,7 +68,17 @@ public:
 
 private:
   tls::opaque<2> _identity;
-  SignaturePublicKey _public_key;
+  SignatureScheme _scheme = DUMMY_SIG_SCHEME;
+  tls::opaque<2> _key_data;
+
+  // Unmarshaling keeps only the raw key bytes above; the OpenSSL key
+  // import happens here, on first use.  Most entries in a large
+  // roster are never touched, and copies of a materialized credential
+  // share the imported key.  The import runs under a once_flag, since
+  // the same roster entry can be verified from several threads at
+  // once.
+  mutable std::optional<SignaturePublicKey> _public_key;
+  mutable std::once_flag _public_key_once;
 };
 
 // struct {
@@ -150,7 +171,15 @@ class Roster
 public:
   void add(uint32_t index, const Credential& cred);
   void remove(uint32_t index);
-  Credential get(uint32_t index) const;
+
+  // Returns a reference into the roster, so that the referenced
+  // entry's lazily-imported public key is materialized at most once
+  // per slot, no matter how many messages the same signer sends
+  const Credential& get(uint32_t index) const;
+
+  // Whether the slot at this index currently holds a credential
+  bool has(uint32_t index) const;
+
   size_t size() const;
   void truncate(uint32_t size);
 
@@ -159,6 +188,12 @@ private:
   typedef tls::vector<OptionalCredential, 4> CredentialVector;
   CredentialVector _credentials;
 
+  // Cache of per-slot encodings, invalidated on add/remove, so that
+  // marshaling the roster for the key schedule only re-encodes
+  // credentials that changed (cf. RatchetTreeNodes)
+  mutable std::map<uint32_t, bytes> _enc_cache;
+  const bytes& credential_encoding(uint32_t index) const;
+
   friend bool operator==(const Roster& lhs, const Roster& rhs);
   friend tls::ostream& operator<<(tls::ostream& out, const Roster& obj);
   friend tls::istream& operator>>(tls::istream& in, Roster& obj);
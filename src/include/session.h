@@ -3,6 +3,8 @@
 #include "common.h"
 #include "state.h"
 #include "tls_syntax.h"
+#include <functional>
+#include <future>
 #include <map>
 
 namespace mls {
@@ -32,7 +34,57 @@ public:
   void join(const bytes& welcome, const bytes& add);
   void handle(const bytes& handshake_data);
 
+  // A parsed and fully verified handshake message, ready to be
+  // committed.  All of the expensive work -- unmarshal, tree
+  // decryption, epoch derivation, signature verification -- happens
+  // in prepare(); commit() only installs the resulting state.
+  struct PendingHandshake
+  {
+    epoch_t prior_epoch;
+    State next;
+  };
+
+  // Split-phase variant of handle(), so that a driver can overlap the
+  // prepare stage of one group's message with the commit stage of
+  // another's.  prepare() does not mutate the session, so it is safe
+  // to run on a worker thread, as long as no commit lands on this
+  // session while it runs.
+  PendingHandshake prepare(const bytes& handshake_data) const;
+  void commit(const PendingHandshake& pending);
+
+  // Run the prepare stage on a worker thread; the caller commits the
+  // result once the future resolves.  The current state is copied on
+  // the calling thread, so the worker shares no session state with
+  // the caller: several handle_async calls may overlap with each
+  // other and with other use of this session, as long as the session
+  // itself is not mutated concurrently with the handle_async call.
+  std::future<PendingHandshake> handle_async(
+    const bytes& handshake_data) const;
+
+  // Retention policy: keep at most `max_epochs` states resident,
+  // evicting the oldest (but never the current) as new epochs
+  // arrive.  Zero means unbounded, which is the default.
+  void set_retention(size_t max_epochs);
+
+  // Called with each state as it is evicted, so that the application
+  // can serialize or archive it before it is dropped
+  typedef std::function<void(epoch_t, const State&)> EvictionHandler;
+  void set_eviction_handler(EvictionHandler handler);
+
+  // Number of states currently resident
+  size_t resident_epochs() const;
+
+  // Serialize the whole session -- including all resident states --
+  // into a versioned snapshot
+  bytes save() const;
+
+  // Reconstitute a session from a snapshot
+  static Session restore(const bytes& data);
+
 protected:
+  // Minimal initialization, for restoring from a snapshot
+  Session(SignaturePrivateKey identity_priv, Credential credential);
+
   CipherList _supported_ciphersuites;
   bytes _init_secret;
   tls::opaque<2> _user_init_key;
@@ -40,9 +92,12 @@ protected:
   Credential _credential;
   std::map<epoch_t, State> _state;
   epoch_t _current_epoch;
+  size_t _max_epochs = 0;
+  EvictionHandler _on_evict;
 
   void make_init_key();
   void add_state(epoch_t prior_epoch, const State& state);
+  void prune();
   State& current_state();
   const State& current_state() const;
 };
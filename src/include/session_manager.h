@@ -0,0 +1,107 @@
+#pragma once
+
+#include "common.h"
+#include "session.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mls {
+
+// An engine that owns many independent groups and processes their
+// handshake traffic on a pool of worker threads.  Operations on
+// distinct groups share no state, so they run fully parallel;
+// messages for the same group are processed one at a time, in
+// submission order.
+//
+// Each group has a home worker (chosen by hashing its group ID), and
+// a worker whose own queue is empty steals runnable groups from the
+// other workers' queues.  A group moves between workers only as a
+// whole, never while it is being processed, so per-group ordering is
+// preserved.
+class SessionManager
+{
+public:
+  // One worker per hardware thread
+  SessionManager();
+  explicit SessionManager(size_t n_workers);
+  ~SessionManager();
+
+  SessionManager(const SessionManager& other) = delete;
+  SessionManager& operator=(const SessionManager& other) = delete;
+
+  // The outcome of one submitted message
+  struct Result
+  {
+    uint64_t ticket;
+    bytes group_id;
+    bool ok;
+    std::string error;
+  };
+
+  // Place a session under management
+  void add_session(const bytes& group_id, Session session);
+
+  // Drop a group, after any messages already submitted for it have
+  // been processed
+  void remove_session(const bytes& group_id);
+
+  // Run a function over a group's session, serialized with respect
+  // to message processing on that group
+  void with_session(const bytes& group_id,
+                    const std::function<void(Session&)>& function);
+
+  // Queue a handshake message for a group.  The returned ticket
+  // appears in a poll() result once the message has been processed.
+  uint64_t submit(const bytes& group_id, const bytes& handshake_data);
+
+  // Drain the results completed so far
+  std::vector<Result> poll();
+
+  // Block until everything submitted so far has been processed
+  void flush();
+
+  // Number of groups under management
+  size_t size() const;
+
+private:
+  struct Message
+  {
+    uint64_t ticket;
+    bytes data;
+  };
+
+  struct Group
+  {
+    Session session;
+    std::deque<Message> pending;
+
+    // Set while the group is in a runnable queue or being processed
+    // by a worker; no other worker may touch it
+    bool scheduled = false;
+
+    Group(Session session)
+      : session(std::move(session))
+    {}
+  };
+
+  mutable std::mutex _mutex;
+  std::condition_variable _work;
+  std::condition_variable _idle;
+  std::map<bytes, Group> _groups;
+  std::vector<std::deque<bytes>> _runnable;
+  std::vector<std::thread> _workers;
+  std::vector<Result> _results;
+  uint64_t _next_ticket = 0;
+  size_t _in_flight = 0;
+  bool _running = true;
+
+  size_t home_worker(const bytes& group_id) const;
+  void worker(size_t index);
+};
+
+} // namespace mls
@@ -4,6 +4,8 @@
 #include "messages.h"
 #include "ratchet_tree.h"
 #include "roster.h"
+#include <map>
+#include <memory>
 #include <optional>
 #include <vector>
 
@@ -38,10 +40,18 @@ struct GroupState
   friend bool operator==(const GroupState& lhs, const GroupState& rhs);
 };
 
-// XXX(rlb@ipv.sx): This is implemented in "const mode", where we
-// never ratchet forward the base secret.  This allows for maximal
-// out-of-order delivery, but provides no forward secrecy within an
-// epoch.
+// This runs in one of two modes:
+//
+// * In "const mode" (the default), we never ratchet forward the
+//   base secret.  This allows for maximal out-of-order delivery,
+//   but provides no forward secrecy within an epoch.
+//
+// * In "ratcheting mode", the chain advances irreversibly as
+//   generations are requested, retaining only a sliding window of
+//   secrets for skipped generations (to allow for out-of-order
+//   delivery).  Secrets behind the window are deleted, so memory
+//   stays flat and compromise of the chain does not expose
+//   delivered messages outside the window.
 class ApplicationKeyChain
 {
 public:
@@ -50,11 +60,32 @@ public:
                       const bytes& app_secret)
     : _suite(suite)
     , _sender(tls::marshal(sender))
-    , _secret_size(Digest(suite).output_size())
-    , _key_size(AESGCM::key_size(suite))
-    , _nonce_size(AESGCM::nonce_size)
+    , _secret_size(suite_digest_size(suite))
+    , _key_size(suite_key_size(suite))
+    , _nonce_size(suite_nonce_size(suite))
+    , _secret_tmpl(_secret_label, _secret_size)
+    , _key_tmpl(_key_label, _key_size)
+    , _nonce_tmpl(_nonce_label, _nonce_size)
   {
-    _base_secret = derive(app_secret, _secret_label, _secret_size);
+    _base_secret = derive(to_secure(app_secret));
+    _next_secret = _base_secret;
+  }
+
+  ApplicationKeyChain(CipherSuite suite,
+                      uint32_t sender,
+                      const bytes& app_secret,
+                      uint32_t window_size)
+    : ApplicationKeyChain(suite, sender, app_secret)
+  {
+    if (window_size == 0) {
+      throw InvalidParameterError("Retention window must be non-empty");
+    }
+
+    _ratcheting = true;
+    _window_size = window_size;
+
+    // In ratcheting mode, old secrets live only in the window
+    _base_secret.clear();
   }
 
   struct KeyAndNonce
@@ -69,12 +100,36 @@ public:
 private:
   CipherSuite _suite;
   bytes _sender;
-  bytes _base_secret;
+  secure_bytes _base_secret;
+
+  // Memoization state, so that repeated and sequential requests
+  // don't have to re-derive from the base secret.  The "frontier" is
+  // the highest generation that has been derived so far; the cache
+  // holds keys for recently requested generations.
+  static const size_t _max_cache_size = 32;
+  mutable uint32_t _next_generation = 0;
+  mutable secure_bytes _next_secret;
+  mutable std::map<uint32_t, KeyAndNonce> _cache;
+
+  // Ratcheting-mode state: the window of retained secrets covers
+  // generations in [_window_floor, _next_generation)
+  bool _ratcheting = false;
+  uint32_t _window_size = 0;
+  mutable uint32_t _window_floor = 0;
+  mutable std::map<uint32_t, secure_bytes> _window;
+
+  KeyAndNonce get_ratcheting(uint32_t generation) const;
 
   size_t _secret_size;
   size_t _key_size;
   size_t _nonce_size;
 
+  // Precompiled HKDF labels, so that only the context splice and the
+  // HMAC itself run on the per-message path
+  HKDFLabelTemplate _secret_tmpl;
+  HKDFLabelTemplate _key_tmpl;
+  HKDFLabelTemplate _nonce_tmpl;
+
   // XXX(rlb@ipv.sx) Using char* here instead of std::string because
   // the linter complains about static objects and objects with
   // global scope.
@@ -82,9 +137,33 @@ private:
   static const char* _nonce_label;
   static const char* _key_label;
 
-  bytes derive(const bytes& secret,
-               const std::string& label,
-               const size_t size) const;
+  secure_bytes derive(const secure_bytes& secret) const;
+};
+
+// Content-addressed memoization for handshake fan-in.  A server
+// process hosting several members of one group receives the same
+// broadcast Handshake once per member, and each delivery would
+// otherwise repeat the full parse and signature verification.
+// Entries are keyed by a digest of the content, so identical
+// deliveries reuse the work done on the first arrival.  Tree
+// decryption is not shared; it depends on the receiving leaf's
+// private keys.
+class HandshakeCache
+{
+public:
+  // Parse an encoded handshake, reusing the parse from a previous
+  // identical delivery if there was one
+  static std::shared_ptr<const Handshake> parse(CipherSuite suite,
+                                                const bytes& encoded);
+
+  // Check a signature, reusing the result of a previous check of the
+  // same signature by the same key over the same content
+  static bool check_signature(const SignaturePublicKey& pub,
+                              const bytes& message,
+                              const bytes& signature);
+
+  // Drop all cached entries
+  static void reset();
 };
 
 class State
@@ -130,6 +209,11 @@ public:
   std::pair<Welcome, Handshake> add(uint32_t index,
                                     const UserInitKey& user_init_key) const;
 
+  // Generate a BulkAdd message covering a whole batch of new members
+  // with one epoch change, along with one Welcome per member
+  std::pair<std::vector<Welcome>, Handshake> add(
+    const std::vector<UserInitKey>& user_init_keys) const;
+
   // Generate an Update message (for post-compromise security)
   Handshake update(const bytes& leaf_secret);
 
@@ -141,16 +225,38 @@ public:
   ///
   State handle(const Handshake& handshake) const;
 
+  // Apply an ordered run of handshake messages (e.g., a replay after
+  // reconnect) to a single working copy of the state, instead of
+  // deep-copying the state once per message
+  State handle_batch(const std::vector<Handshake>& handshakes) const;
+
+  // Verify the signatures on an ordered run of handshake messages in
+  // one batch, before applying it with handle_batch.  This only
+  // checks signatures (over the chained transcript hashes); the
+  // confirmation MACs are still checked when the run is applied.
+  bool verify_batch(const std::vector<Handshake>& handshakes) const;
+
+  ///
+  /// Persistence
+  ///
+
+  // Serialize the full state -- including the private per-participant
+  // fields -- into a versioned snapshot
+  bytes snapshot() const;
+
+  // Reconstitute a state from a snapshot
+  static State restore(const bytes& data);
+
   ///
   /// Accessors
   ///
   epoch_t epoch() const { return _state.epoch; }
   LeafIndex index() const { return _index; }
   CipherSuite cipher_suite() const { return _suite; }
-  bytes epoch_secret() const { return _epoch_secret; }
-  bytes application_secret() const { return _application_secret; }
-  bytes confirmation_key() const { return _confirmation_key; }
-  bytes init_secret() const { return _init_secret; }
+  bytes epoch_secret() const { return from_secure(_epoch_secret); }
+  bytes application_secret() const { return from_secure(_application_secret); }
+  bytes confirmation_key() const { return from_secure(_confirmation_key); }
+  bytes init_secret() const { return from_secure(_init_secret); }
 
   ///
   /// Static access to the key schedule
@@ -168,20 +274,24 @@ public:
                                            const GroupState& state);
 
 private:
+  // Minimal initialization, for restoring from a snapshot
+  State(CipherSuite suite, SignaturePrivateKey identity_priv);
+
   // Shared confirmed state:
   CipherSuite _suite;
   GroupState _state;
 
-  // Shared secret state
-  tls::opaque<1> _epoch_secret;
-  tls::opaque<1> _application_secret;
-  tls::opaque<1> _confirmation_key;
-  tls::opaque<1> _init_secret;
+  // Shared secret state, held in zeroizing storage; converted to
+  // ordinary bytes only at the crypto and serialization boundaries
+  secure_bytes _epoch_secret;
+  secure_bytes _application_secret;
+  secure_bytes _confirmation_key;
+  secure_bytes _init_secret;
 
   // Per-participant state
   LeafIndex _index;
   SignaturePrivateKey _identity_priv;
-  bytes _cached_leaf_secret;
+  secure_bytes _cached_leaf_secret;
 
   // A zero vector, for convenience
   bytes _zero;
@@ -189,9 +299,15 @@ private:
   // Specific operation handlers
   State handle(LeafIndex signer_index, const GroupOperation& operation) const;
 
+  // Apply an operation to this state in place, advancing the epoch
+  void apply(LeafIndex signer_index, const GroupOperation& operation);
+
   // Handle a Add (for existing participants only)
   bytes handle(const Add& add);
 
+  // Handle a BulkAdd (for existing participants only)
+  bytes handle(const BulkAdd& bulk_add);
+
   // Handle an Update (for the participant that sent the update)
   bytes handle(LeafIndex index, const Update& update);
 
@@ -4,8 +4,13 @@
 #include <array>
 #include <map>
 #include <optional>
+#include <type_traits>
 #include <vector>
 
+// Instrumentation hooks only; metrics.h depends on nothing but the
+// standard library, so this layer stays otherwise TLS-generic
+#include "metrics.h"
+
 // Note: Different namespace because this is TLS-generic (might
 // want to pull it out later).  Also, avoids confusables ending up
 // in the global namespace, e.g., vector, istream, ostream.
@@ -152,17 +157,53 @@ operator==(const variant_optional<T, C>& lhs, const variant_optional<T, C>& rhs)
 template<size_t head, size_t min = tls::none, size_t max = tls::none>
 using opaque = vector<uint8_t, head, min, max>;
 
+template<size_t head, size_t min = tls::none, size_t max = tls::none>
+struct opaque_ref;
+
+// A writer that targets one of three destinations:
+//
+// * An owned, growable buffer (the default)
+// * A caller-provided buffer of fixed size (via `wrap`), so that
+//   callers can serialize directly into transport frames
+// * Nothing at all (via `counting`), in which case the stream just
+//   tallies the encoded size without writing any bytes
+//
+// The counting mode lets marshal() pre-compute the exact output
+// size and serialize a whole structure with a single allocation.
 class ostream
 {
 public:
   static const size_t none = -1;
 
+  static ostream counting()
+  {
+    ostream out;
+    out._counting = true;
+    return out;
+  }
+
+  static ostream wrap(uint8_t* data, size_t size)
+  {
+    ostream out;
+    out._extern = data;
+    out._extern_size = size;
+    return out;
+  }
+
   void write_raw(const std::vector<uint8_t>& bytes);
 
   std::vector<uint8_t> bytes() const { return _buffer; }
+  size_t size() const;
+  void reserve(size_t size) { _buffer.reserve(size); }
 
 private:
   std::vector<uint8_t> _buffer;
+  uint8_t* _extern = nullptr;
+  size_t _extern_size = 0;
+  size_t _written = 0;
+  bool _counting = false;
+
+  void append(const uint8_t* data, size_t size);
   ostream& write_uint(uint64_t value, int length);
 
   friend ostream& operator<<(ostream& out, uint8_t data);
@@ -214,16 +255,31 @@ operator<<(ostream& out, const vector_base<T, head, min, max>& data)
       throw WriteError("Invalid header size");
   }
 
-  // Pre-encode contents
-  ostream temp;
-  size_t i = 0;
+  // Byte strings can be written en masse, without a counting pass
+  if constexpr (std::is_same<T, uint8_t>::value) {
+    uint64_t byte_size = data.size();
+    if (byte_size > head_max) {
+      throw WriteError("Data too large for header size");
+    } else if ((max != none) && (byte_size > max)) {
+      throw WriteError("Data too large for declared max");
+    } else if ((min != none) && (byte_size < min)) {
+      throw WriteError("Data too small for declared min");
+    }
+
+    out.write_uint(byte_size, head);
+    out.append(data.data(), data.size());
+    return out;
+  }
+
+  // Pre-compute the encoded size of the contents, without
+  // allocating a temporary buffer
+  ostream temp = ostream::counting();
   for (const auto& item : data) {
     temp << item;
-    i += 1;
   }
 
   // Check that the encoded length is OK
-  uint64_t size = temp._buffer.size();
+  uint64_t size = temp.size();
   if (size > head_max) {
     throw WriteError("Data too large for header size");
   } else if ((max != none) && (size > max)) {
@@ -232,10 +288,11 @@ operator<<(ostream& out, const vector_base<T, head, min, max>& data)
     throw WriteError("Data too small for declared min");
   }
 
-  // Write the encoded length, then the pre-encoded data
+  // Write the encoded length, then the contents
   out.write_uint(size, head);
-  out._buffer.insert(
-    out._buffer.end(), temp._buffer.begin(), temp._buffer.end());
+  for (const auto& item : data) {
+    out << item;
+  }
 
   return out;
 }
@@ -252,19 +309,47 @@ operator<<(tls::ostream& out, const optional_base<T>& opt)
   return out << uint8_t(1) << opt.value();
 }
 
+// A reader over a byte buffer.  The stream either owns a copy of
+// the input (when constructed from a vector) or aliases an external
+// buffer (when constructed via `ref`); in the latter case, no bytes
+// are copied on construction or while reading nested vectors, and
+// the caller must keep the underlying buffer alive for the lifetime
+// of the stream.
 class istream
 {
 public:
   istream(const std::vector<uint8_t>& data)
-    : _buffer(data)
+    : _owned(data)
+    , _data(_owned.data())
+    , _size(_owned.size())
+    , _pos(0)
+  {}
+
+  istream(const istream& other) = delete;
+  istream& operator=(const istream& other) = delete;
+  istream(istream&& other) = default;
+
+  static istream ref(const uint8_t* data, size_t size)
   {
-    // So that we can use the constant-time pop_back
-    std::reverse(_buffer.begin(), _buffer.end());
+    istream r;
+    r._data = data;
+    r._size = size;
+    return r;
   }
 
 private:
-  istream() {}
-  std::vector<uint8_t> _buffer;
+  istream()
+    : _data(nullptr)
+    , _size(0)
+    , _pos(0)
+  {}
+
+  std::vector<uint8_t> _owned;
+  const uint8_t* _data;
+  size_t _size;
+  size_t _pos;
+
+  size_t remaining() const { return _size - _pos; }
   uint8_t next();
 
   template<typename T>
@@ -280,8 +365,41 @@ private:
 
   template<typename T, size_t head, size_t min, size_t max>
   friend istream& operator>>(istream& in, vector_base<T, head, min, max>& data);
+
+  template<size_t head, size_t min, size_t max>
+  friend istream& operator>>(istream& in, opaque_ref<head, min, max>& data);
 };
 
+// A non-owning reference to a length-prefixed byte string.  Reading
+// one of these records a pointer into the stream's underlying buffer
+// instead of copying, so it is only valid as long as that buffer is.
+template<size_t head, size_t min, size_t max>
+struct opaque_ref
+{
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+};
+
+template<size_t head, size_t min, size_t max>
+istream&
+operator>>(istream& in, opaque_ref<head, min, max>& data)
+{
+  uint64_t size = 0;
+  in.read_uint(size, head);
+  if (size > in.remaining()) {
+    throw ReadError("Declared size exceeds available data size");
+  } else if ((max != none) && (size > max)) {
+    throw ReadError("Data too large for declared max");
+  } else if ((min != none) && (size < min)) {
+    throw ReadError("Data too small for declared min");
+  }
+
+  data.data = in._data + in._pos;
+  data.size = size;
+  in._pos += size;
+  return in;
+}
+
 // Primitive type readers defined in .cpp file
 
 // Array reader
@@ -314,7 +432,7 @@ operator>>(istream& in, vector_base<T, head, min, max>& data)
   // declared constraints
   uint64_t size = 0;
   in.read_uint(size, head);
-  if (size > in._buffer.size()) {
+  if (size > in.remaining()) {
     throw ReadError("Declared size exceeds available data size");
   } else if ((max != none) && (size > max)) {
     throw ReadError("Data too large for declared max");
@@ -325,21 +443,25 @@ operator>>(istream& in, vector_base<T, head, min, max>& data)
   // Truncate the data buffer
   data.clear();
 
-  // Truncate the buffer to the declared length and wrap it in a
-  // new reader, then read items from it
-  // NB: Remember that we store the vector in reverse order
+  // Byte strings can be read en masse, without a nested reader
+  if constexpr (std::is_same<T, uint8_t>::value) {
+    data.assign(in._data + in._pos, in._data + in._pos + size);
+    in._pos += size;
+    return in;
+  }
+
+  // Wrap a new reader around a view of the declared length, then
+  // read items from it
   // NB: This requires that T be default-constructible
-  std::vector<uint8_t> trunc(in._buffer.end() - size, in._buffer.end());
-  istream r;
-  r._buffer = trunc;
-  while (r._buffer.size() > 0) {
+  istream r = istream::ref(in._data + in._pos, size);
+  while (r.remaining() > 0) {
     auto temp = data.new_element();
     r >> temp;
     data.push_back(temp);
   }
 
-  // Truncate the primary buffer
-  in._buffer.erase(in._buffer.end() - size, in._buffer.end());
+  // Advance the primary reader past the view
+  in._pos += size;
 
   return in;
 }
@@ -367,15 +489,38 @@ operator>>(tls::istream& in, optional_base<T>& opt)
 }
 
 // Abbreviations
+template<typename T>
+size_t
+marshal_size(const T& value)
+{
+  ostream counter = ostream::counting();
+  counter << value;
+  return counter.size();
+}
+
 template<typename T>
 std::vector<uint8_t>
 marshal(const T& value)
 {
   ostream w;
+  w.reserve(marshal_size(value));
   w << value;
+  mls::metrics::count(mls::metrics::Counter::marshal_bytes, w.size());
   return w.bytes();
 }
 
+// Serialize into a caller-provided buffer (e.g., a transport
+// frame), returning the number of bytes written
+template<typename T>
+size_t
+marshal_into(const T& value, uint8_t* data, size_t size)
+{
+  ostream w = ostream::wrap(data, size);
+  w << value;
+  mls::metrics::count(mls::metrics::Counter::marshal_bytes, w.size());
+  return w.size();
+}
+
 template<typename T>
 void
 unmarshal(const std::vector<uint8_t>& data, T& value)
@@ -384,4 +529,14 @@ unmarshal(const std::vector<uint8_t>& data, T& value)
   r >> value;
 }
 
+// Zero-copy variant for external buffers (e.g., network frames);
+// the buffer need only outlive this call
+template<typename T>
+void
+unmarshal(const uint8_t* data, size_t size, T& value)
+{
+  auto r = istream::ref(data, size);
+  r >> value;
+}
+
 } // namespace tls
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <memory>
 #include <vector>
 
 // The below functions provide the index calculus for the tree
@@ -115,6 +116,31 @@ dirpath(NodeIndex x, NodeCount w);
 std::vector<NodeIndex>
 copath(NodeIndex x, NodeCount w);
 
+// Precomputed dirpath/copath tables for a fixed tree size.  The
+// functions above recompute node relationships bit-by-bit and
+// allocate a fresh vector on every call; for the stable tree sizes
+// typical of a long-lived group, a table computes the index arrays
+// once per size and hands out references into shared storage.
+class PathTable
+{
+public:
+  explicit PathTable(NodeCount w);
+
+  // Cached equivalents of dirpath/copath above
+  const std::vector<NodeIndex>& dirpath(NodeIndex x) const;
+  const std::vector<NodeIndex>& copath(NodeIndex x) const;
+
+  // Returns a process-wide shared table for the given tree size,
+  // building it on first use.  A handful of recently used sizes stay
+  // resident; holding the returned pointer keeps a table alive even
+  // after it is evicted from the cache.
+  static std::shared_ptr<const PathTable> get(NodeCount w);
+
+private:
+  std::vector<std::vector<NodeIndex>> _dirpaths;
+  std::vector<std::vector<NodeIndex>> _copaths;
+};
+
 // XXX(rlb@ipv.sx): The templating here is looser than I would like.
 // Really it should be something like vector<optional<T>>
 template<typename T>
@@ -130,6 +130,114 @@ WelcomeInfo::hash(CipherSuite suite) const
   return Digest(suite).write(marshaled).digest();
 }
 
+// Compact WelcomeInfo encodings are distinguished from the canonical
+// TLS encoding by their first byte: the canonical encoding begins
+// with ProtocolVersion mls10Version (0xFF), which neither marker
+// value uses.
+static const uint8_t compact_welcome_full = 1;
+static const uint8_t compact_welcome_delta = 2;
+
+bytes
+WelcomeInfo::compact() const
+{
+  tls::ostream out;
+  out << compact_welcome_full << version << group_id << epoch << roster
+      << transcript_hash << init_secret << tls::opaque<4>(tree.compact());
+  return out.bytes();
+}
+
+bytes
+WelcomeInfo::compact_delta(const WelcomeInfo& prior) const
+{
+  tls::ostream out;
+  out << compact_welcome_delta << version << group_id << epoch;
+
+  // Roster delta: the new size, then the slots that changed
+  auto n_entries = uint32_t(roster.size());
+  std::vector<uint32_t> changed;
+  for (uint32_t i = 0; i < n_entries; i += 1) {
+    if (roster.has(i) != prior.roster.has(i)) {
+      changed.push_back(i);
+      continue;
+    }
+
+    if (roster.has(i) && roster.get(i) != prior.roster.get(i)) {
+      changed.push_back(i);
+    }
+  }
+
+  out << n_entries << uint32_t(changed.size());
+  for (const auto i : changed) {
+    auto entry = tls::optional<Credential>{};
+    if (roster.has(i)) {
+      entry = roster.get(i);
+    }
+
+    out << i << entry;
+  }
+
+  out << transcript_hash << init_secret
+      << tls::opaque<4>(tree.compact_delta(prior.tree));
+  return out.bytes();
+}
+
+WelcomeInfo
+WelcomeInfo::decompact(CipherSuite suite, const bytes& data)
+{
+  auto in = tls::istream::ref(data.data(), data.size());
+
+  uint8_t marker;
+  in >> marker;
+  if (marker == compact_welcome_delta) {
+    throw ProtocolError("Delta WelcomeInfo requires a prior snapshot");
+  }
+  if (marker != compact_welcome_full) {
+    throw ProtocolError("Unknown compact WelcomeInfo marker");
+  }
+
+  WelcomeInfo info{ suite };
+  tls::opaque<4> tree_data;
+  in >> info.version >> info.group_id >> info.epoch >> info.roster >>
+    info.transcript_hash >> info.init_secret >> tree_data;
+  info.tree = RatchetTree::decompact(suite, tree_data);
+  return info;
+}
+
+WelcomeInfo
+WelcomeInfo::decompact_delta(const WelcomeInfo& prior, const bytes& data)
+{
+  auto in = tls::istream::ref(data.data(), data.size());
+
+  uint8_t marker;
+  in >> marker;
+  if (marker != compact_welcome_delta) {
+    throw ProtocolError("Not a delta WelcomeInfo");
+  }
+
+  auto info = prior;
+  in >> info.version >> info.group_id >> info.epoch;
+
+  uint32_t n_entries;
+  uint32_t n_changes;
+  in >> n_entries >> n_changes;
+  info.roster.truncate(n_entries);
+  for (uint32_t c = 0; c < n_changes; c += 1) {
+    uint32_t index;
+    auto entry = tls::optional<Credential>{};
+    in >> index >> entry;
+    if (entry) {
+      info.roster.add(index, *entry);
+    } else {
+      info.roster.remove(index);
+    }
+  }
+
+  tls::opaque<4> tree_data;
+  in >> info.transcript_hash >> info.init_secret >> tree_data;
+  info.tree = RatchetTree::decompact_delta(prior.tree, tree_data);
+  return info;
+}
+
 bool
 operator==(const WelcomeInfo& lhs, const WelcomeInfo& rhs)
 {
@@ -173,10 +281,29 @@ Welcome::Welcome(const bytes& id,
   , encrypted_welcome_info(pub.encrypt(tls::marshal(info)))
 {}
 
+Welcome
+Welcome::with_compact_info(const bytes& id,
+                           const DHPublicKey& pub,
+                           const WelcomeInfo& info)
+{
+  Welcome welcome;
+  welcome.user_init_key_id = id;
+  welcome.cipher_suite = pub.cipher_suite();
+  welcome.encrypted_welcome_info = pub.encrypt(info.compact());
+  return welcome;
+}
+
 WelcomeInfo
 Welcome::decrypt(const DHPrivateKey& priv) const
 {
   auto welcome_info_bytes = priv.decrypt(encrypted_welcome_info);
+
+  // The canonical encoding leads with mls10Version; anything else is
+  // a compact encoding
+  if (!welcome_info_bytes.empty() && welcome_info_bytes[0] != mls10Version) {
+    return WelcomeInfo::decompact(priv.cipher_suite(), welcome_info_bytes);
+  }
+
   auto welcome_info = WelcomeInfo{ priv.cipher_suite() };
   tls::unmarshal(welcome_info_bytes, welcome_info);
   return welcome_info;
@@ -291,6 +418,29 @@ operator>>(tls::istream& in, Remove& obj)
   return in >> obj.removed >> obj.path;
 }
 
+// BulkAdd
+
+const GroupOperationType BulkAdd::type = GroupOperationType::bulk_add;
+
+bool
+operator==(const BulkAdd& lhs, const BulkAdd& rhs)
+{
+  return (lhs.index == rhs.index) && (lhs.init_keys == rhs.init_keys) &&
+         (lhs.welcome_info_hash == rhs.welcome_info_hash);
+}
+
+tls::ostream&
+operator<<(tls::ostream& out, const BulkAdd& obj)
+{
+  return out << obj.index << obj.init_keys << obj.welcome_info_hash;
+}
+
+tls::istream&
+operator>>(tls::istream& in, BulkAdd& obj)
+{
+  return in >> obj.index >> obj.init_keys >> obj.welcome_info_hash;
+}
+
 // GroupOperation
 bool
 operator==(const GroupOperation& lhs, const GroupOperation& rhs)
@@ -300,7 +450,9 @@ operator==(const GroupOperation& lhs, const GroupOperation& rhs)
           ((lhs.type == GroupOperationType::update) &&
            (lhs.update == rhs.update)) ||
           ((lhs.type == GroupOperationType::remove) &&
-           (lhs.remove == rhs.remove)));
+           (lhs.remove == rhs.remove)) ||
+          ((lhs.type == GroupOperationType::bulk_add) &&
+           (lhs.bulk_add == rhs.bulk_add)));
 }
 
 tls::ostream&
@@ -315,6 +467,8 @@ operator<<(tls::ostream& out, const GroupOperation& obj)
       return out << obj.update;
     case GroupOperationType::remove:
       return out << obj.remove;
+    case GroupOperationType::bulk_add:
+      return out << obj.bulk_add;
   }
 
   throw InvalidParameterError("Unknown group operation type");
@@ -332,6 +486,8 @@ operator>>(tls::istream& in, GroupOperation& obj)
       return in >> obj.update;
     case GroupOperationType::remove:
       return in >> obj.remove;
+    case GroupOperationType::bulk_add:
+      return in >> obj.bulk_add;
   }
 
   throw InvalidParameterError("Unknown group operation type");
@@ -362,4 +518,114 @@ operator>>(tls::istream& in, Handshake& obj)
          obj.signature >> obj.confirmation;
 }
 
+// HandshakeHeader
+
+namespace {
+
+// Minimal big-endian cursor over a raw buffer.  Reads the fixed
+// fields and skips over length-prefixed ones without copying.
+struct PeekCursor
+{
+  const uint8_t* data;
+  size_t size;
+  size_t pos = 0;
+
+  uint64_t read_uint(size_t length)
+  {
+    if (length > size - pos) {
+      throw tls::ReadError("Attempt to read past the end of the buffer");
+    }
+
+    uint64_t value = 0;
+    for (size_t i = 0; i < length; i += 1) {
+      value = (value << 8) | data[pos + i];
+    }
+
+    pos += length;
+    return value;
+  }
+
+  void skip(uint64_t length)
+  {
+    if (length > size - pos) {
+      throw tls::ReadError("Attempt to read past the end of the buffer");
+    }
+
+    pos += length;
+  }
+
+  void skip_vector(size_t head) { skip(read_uint(head)); }
+};
+
+void
+skip_user_init_key(PeekCursor& cursor)
+{
+  cursor.skip_vector(1); // user_init_key_id
+  cursor.skip_vector(1); // supported_versions
+  cursor.skip_vector(1); // cipher_suites
+  cursor.skip_vector(2); // init_keys
+
+  auto credential_type = static_cast<CredentialType>(cursor.read_uint(1));
+  switch (credential_type) {
+    case CredentialType::basic:
+      cursor.skip_vector(2); // identity
+      cursor.skip(2);        // signature scheme
+      cursor.skip_vector(2); // public key
+      break;
+
+    default:
+      throw tls::ReadError("Unknown credential type");
+  }
+
+  cursor.skip_vector(2); // signature
+}
+
+} // namespace
+
+HandshakeHeader
+HandshakeHeader::peek(const uint8_t* data, size_t size)
+{
+  PeekCursor cursor{ data, size };
+
+  HandshakeHeader header;
+  header.prior_epoch = static_cast<epoch_t>(cursor.read_uint(4));
+  header.operation_type =
+    static_cast<GroupOperationType>(cursor.read_uint(1));
+
+  switch (header.operation_type) {
+    case GroupOperationType::add:
+      cursor.skip(4); // index
+      skip_user_init_key(cursor);
+      cursor.skip_vector(1); // welcome_info_hash
+      break;
+
+    case GroupOperationType::update:
+      cursor.skip_vector(2); // path
+      break;
+
+    case GroupOperationType::remove:
+      cursor.skip(4);        // removed
+      cursor.skip_vector(2); // path
+      break;
+
+    case GroupOperationType::bulk_add:
+      cursor.skip(4);        // index
+      cursor.skip_vector(4); // init_keys
+      cursor.skip_vector(1); // welcome_info_hash
+      break;
+
+    default:
+      throw tls::ReadError("Unknown group operation type");
+  }
+
+  header.signer_index = LeafIndex{ static_cast<uint32_t>(cursor.read_uint(4)) };
+  return header;
+}
+
+HandshakeHeader
+HandshakeHeader::peek(const bytes& data)
+{
+  return peek(data.data(), data.size());
+}
+
 } // namespace mls
@@ -0,0 +1,104 @@
+#include "metrics.h"
+#include <atomic>
+
+namespace mls {
+namespace metrics {
+
+namespace {
+
+const std::array<const char*, size_t(Counter::max)> counter_names = {
+  "hpke_encrypt",     "hpke_decrypt",  "signature_sign",
+  "signature_verify", "aes_gcm_encrypt", "aes_gcm_decrypt",
+  "digest_bytes",     "marshal_bytes", "handshakes_handled",
+};
+
+const std::array<const char*, size_t(Timer::max)> timer_names = {
+  "handshake_handle",
+  "tree_encrypt",
+  "tree_decrypt",
+};
+
+std::array<std::atomic<uint64_t>, size_t(Counter::max)> counters = {};
+
+struct TimerState
+{
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> total_us;
+  std::array<std::atomic<uint64_t>, Histogram::n_buckets> buckets;
+};
+
+std::array<TimerState, size_t(Timer::max)> timers = {};
+
+size_t
+bucket_for(uint64_t us)
+{
+  size_t bucket = 0;
+  while (us > 0 && bucket < Histogram::n_buckets - 1) {
+    us >>= 1;
+    bucket += 1;
+  }
+  return bucket;
+}
+
+} // namespace
+
+Snapshot
+snapshot()
+{
+  Snapshot out;
+
+  for (size_t i = 0; i < counters.size(); i += 1) {
+    out.counters.emplace(counter_names[i],
+                         counters[i].load(std::memory_order_relaxed));
+  }
+
+  for (size_t i = 0; i < timers.size(); i += 1) {
+    Histogram hist;
+    hist.count = timers[i].count.load(std::memory_order_relaxed);
+    hist.total_us = timers[i].total_us.load(std::memory_order_relaxed);
+    for (size_t b = 0; b < Histogram::n_buckets; b += 1) {
+      hist.buckets[b] = timers[i].buckets[b].load(std::memory_order_relaxed);
+    }
+    out.timers.emplace(timer_names[i], hist);
+  }
+
+  return out;
+}
+
+void
+reset()
+{
+  for (auto& counter : counters) {
+    counter.store(0, std::memory_order_relaxed);
+  }
+
+  for (auto& timer : timers) {
+    timer.count.store(0, std::memory_order_relaxed);
+    timer.total_us.store(0, std::memory_order_relaxed);
+    for (auto& bucket : timer.buckets) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+#ifdef MLS_METRICS
+
+void
+count(Counter counter, uint64_t n)
+{
+  counters[size_t(counter)].fetch_add(n, std::memory_order_relaxed);
+}
+
+void
+record_us(Timer timer, uint64_t us)
+{
+  auto& state = timers[size_t(timer)];
+  state.count.fetch_add(1, std::memory_order_relaxed);
+  state.total_us.fetch_add(us, std::memory_order_relaxed);
+  state.buckets[bucket_for(us)].fetch_add(1, std::memory_order_relaxed);
+}
+
+#endif // MLS_METRICS
+
+} // namespace metrics
+} // namespace mls
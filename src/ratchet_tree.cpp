@@ -1,7 +1,10 @@
 #include "ratchet_tree.h"
 #include "common.h"
 #include "messages.h"
+#include "metrics.h"
 #include "tree_math.h"
+#include <algorithm>
+#include <future>
 
 namespace mls {
 
@@ -28,7 +31,7 @@ RatchetTreeNode::operator=(const RatchetTreeNode& other)
 
 RatchetTreeNode::RatchetTreeNode(CipherSuite suite, const bytes& secret)
   : CipherAware(suite)
-  , _secret(secret)
+  , _secret(to_secure(secret))
   , _priv(DHPrivateKey::derive(suite, secret))
   , _pub(suite)
 {
@@ -55,7 +58,7 @@ RatchetTreeNode::public_equal(const RatchetTreeNode& other) const
   return _pub == other._pub;
 }
 
-const std::optional<bytes>&
+const std::optional<secure_bytes>&
 RatchetTreeNode::secret() const
 {
   return _secret;
@@ -140,28 +143,221 @@ const OptionalRatchetTreeNode& RatchetTreeNodeVector::operator[](
   return (*vec)[index.val];
 }
 
+///
+/// RatchetTreeNodes
+///
+
+RatchetTreeNodes::RatchetTreeNodes(CipherSuite suite, bool sparse)
+  : _suite(suite)
+  , _sparse(sparse)
+  , _size(0)
+  , _vec(suite)
+  , _blank(suite)
+{}
+
+const OptionalRatchetTreeNode& RatchetTreeNodes::operator[](
+  const uint32_t index) const
+{
+  if (!_sparse) {
+    return _vec[index];
+  }
+
+  auto node = _map.find(index);
+  if (node == _map.end()) {
+    return _blank;
+  }
+
+  return node->second;
+}
+
+const OptionalRatchetTreeNode& RatchetTreeNodes::operator[](
+  const NodeIndex index) const
+{
+  return (*this)[index.val];
+}
+
+void
+RatchetTreeNodes::set(NodeIndex index, const RatchetTreeNode& node)
+{
+  _enc_cache.erase(index.val);
+
+  if (node.private_key()) {
+    _priv_nodes.insert(index.val);
+  } else {
+    _priv_nodes.erase(index.val);
+  }
+
+  if (!_sparse) {
+    _vec[index] = node;
+    return;
+  }
+
+  _map.insert_or_assign(index.val, OptionalRatchetTreeNode(node));
+}
+
+void
+RatchetTreeNodes::merge(NodeIndex index, const RatchetTreeNode& node)
+{
+  _enc_cache.erase(index.val);
+
+  if (!_sparse) {
+    _vec[index].merge(node);
+  } else {
+    auto entry = _map.find(index.val);
+    if (entry == _map.end()) {
+      entry = _map.emplace(index.val, OptionalRatchetTreeNode(_suite)).first;
+    }
+
+    entry->second.merge(node);
+  }
+
+  // Merging never removes a private key
+  if ((*this)[index]->private_key()) {
+    _priv_nodes.insert(index.val);
+  }
+}
+
+void
+RatchetTreeNodes::blank(NodeIndex index)
+{
+  _enc_cache.erase(index.val);
+  _priv_nodes.erase(index.val);
+
+  if (!_sparse) {
+    _vec[index] = std::nullopt;
+    return;
+  }
+
+  _map.erase(index.val);
+}
+
+void
+RatchetTreeNodes::append_blank()
+{
+  if (!_sparse) {
+    _vec.emplace_back(_suite);
+  }
+
+  _size += 1;
+}
+
+void
+RatchetTreeNodes::append(const RatchetTreeNode& node)
+{
+  if (node.private_key()) {
+    _priv_nodes.insert(uint32_t(_size));
+  }
+
+  if (!_sparse) {
+    _vec.emplace_back(node);
+  } else {
+    _map.emplace(uint32_t(_size), OptionalRatchetTreeNode(node));
+  }
+
+  _size += 1;
+}
+
+void
+RatchetTreeNodes::resize(size_t size)
+{
+  _enc_cache.erase(_enc_cache.lower_bound(uint32_t(size)), _enc_cache.end());
+  _priv_nodes.erase(_priv_nodes.lower_bound(uint32_t(size)),
+                    _priv_nodes.end());
+
+  if (!_sparse) {
+    _vec.resize(size);
+  } else {
+    _map.erase(_map.lower_bound(uint32_t(size)), _map.end());
+  }
+
+  _size = size;
+}
+
+const bytes&
+RatchetTreeNodes::node_encoding(uint32_t index) const
+{
+  auto cached = _enc_cache.find(index);
+  if (cached != _enc_cache.end()) {
+    return cached->second;
+  }
+
+  auto encoding = tls::marshal((*this)[index]);
+  return _enc_cache.emplace(index, std::move(encoding)).first->second;
+}
+
+tls::ostream&
+operator<<(tls::ostream& out, const RatchetTreeNodes& obj)
+{
+  // Both layouts marshal to the dense wire format.  The contents are
+  // assembled from cached per-node encodings, so only nodes touched
+  // since the last marshal are actually re-encoded.
+  size_t total = 0;
+  for (uint32_t i = 0; i < obj._size; i += 1) {
+    total += obj.node_encoding(i).size();
+  }
+
+  tls::vector<uint8_t, 4> data;
+  data.reserve(total);
+  for (uint32_t i = 0; i < obj._size; i += 1) {
+    const auto& encoding = obj.node_encoding(i);
+    data.insert(data.end(), encoding.begin(), encoding.end());
+  }
+
+  return out << data;
+}
+
+tls::istream&
+operator>>(tls::istream& in, RatchetTreeNodes& obj)
+{
+  obj._enc_cache.clear();
+
+  // Unmarshaling carries only public keys
+  obj._priv_nodes.clear();
+
+  if (!obj._sparse) {
+    in >> obj._vec;
+    obj._size = obj._vec.size();
+    return in;
+  }
+
+  RatchetTreeNodeVector vec(obj._suite);
+  in >> vec;
+
+  obj._map.clear();
+  obj._size = vec.size();
+  for (uint32_t i = 0; i < vec.size(); i += 1) {
+    if (vec[i].has_value()) {
+      obj._map.emplace(i, vec[i]);
+    }
+  }
+
+  return in;
+}
+
 ///
 /// RatchetTree
 ///
 
-RatchetTree::RatchetTree(CipherSuite suite)
+RatchetTree::RatchetTree(CipherSuite suite, bool sparse)
   : CipherAware(suite)
-  , _nodes(suite)
-  , _secret_size(Digest(suite).output_size())
+  , _nodes(suite, sparse)
+  , _secret_size(suite_digest_size(suite))
 {}
 
-RatchetTree::RatchetTree(CipherSuite suite, const bytes& secret)
+RatchetTree::RatchetTree(CipherSuite suite, const bytes& secret, bool sparse)
   : CipherAware(suite)
-  , _nodes(suite)
-  , _secret_size(Digest(suite).output_size())
+  , _nodes(suite, sparse)
+  , _secret_size(suite_digest_size(suite))
 {
   add_leaf(LeafIndex{ 0 }, secret);
 }
 
-RatchetTree::RatchetTree(CipherSuite suite, const std::vector<bytes>& secrets)
+RatchetTree::RatchetTree(CipherSuite suite,
+                         const std::vector<bytes>& secrets,
+                         bool sparse)
   : CipherAware(suite)
-  , _nodes(suite)
-  , _secret_size(Digest(suite).output_size())
+  , _nodes(suite, sparse)
+  , _secret_size(suite_digest_size(suite))
 {
   for (uint32_t i = 0; i < secrets.size(); i += 1) {
     add_leaf(LeafIndex{ i }, secrets[i]);
@@ -169,28 +365,70 @@ RatchetTree::RatchetTree(CipherSuite suite, const std::vector<bytes>& secrets)
   }
 }
 
+void
+RatchetTree::set_parallel(bool enabled)
+{
+  _parallel = enabled;
+}
+
 DirectPath
 RatchetTree::encrypt(LeafIndex from, const bytes& leaf_secret) const
 {
+  metrics::ScopedTimer timer(metrics::Timer::tree_encrypt);
+
   DirectPath path{ _suite };
 
   auto leaf_node = new_node(leaf_secret);
   path.nodes.push_back({ leaf_node.public_key(), {} });
 
+  // The path secret chain is inherently serial, but it is cheap; the
+  // public-key operations hanging off of it (node key derivation and
+  // the HPKE fan-out to each resolution node) are independent across
+  // copath nodes, so they can be farmed out to threads
+  auto table = tree_math::PathTable::get(node_size());
+  const auto& copath = table->copath(NodeIndex{ from });
+
+  std::vector<bytes> path_secrets;
+  path_secrets.reserve(copath.size());
   auto path_secret = leaf_secret;
-  auto copath = tree_math::copath(NodeIndex{ from }, node_size());
-  for (const auto& node : copath) {
+  for (size_t i = 0; i < copath.size(); i += 1) {
     path_secret = path_step(path_secret);
+    path_secrets.push_back(path_secret);
+  }
 
+  auto make_node = [&](size_t i) {
     RatchetNode path_node{ _suite };
-    path_node.public_key = new_node(path_secret).public_key();
+    path_node.public_key = new_node(path_secrets[i]).public_key();
 
-    for (const auto& res_node : tree_math::resolve(_nodes, node)) {
-      auto ciphertext = _nodes[res_node]->public_key().encrypt(path_secret);
+    for (const auto& res_node : tree_math::resolve(_nodes, copath[i])) {
+      auto ciphertext = _nodes[res_node]->public_key().encrypt(path_secrets[i]);
       path_node.node_secrets.push_back(ciphertext);
     }
 
-    path.nodes.push_back(path_node);
+    return path_node;
+  };
+
+  if (!_parallel) {
+    for (size_t i = 0; i < copath.size(); i += 1) {
+      path.nodes.push_back(make_node(i));
+    }
+  } else {
+    std::vector<std::future<RatchetNode>> nodes;
+    nodes.reserve(copath.size());
+    for (size_t i = 0; i < copath.size(); i += 1) {
+      nodes.emplace_back(std::async(std::launch::async, make_node, i));
+    }
+
+    for (auto& node : nodes) {
+      path.nodes.push_back(node.get());
+    }
+  }
+
+  // The chain secrets have been encrypted into the path; scrub the
+  // transient copies
+  zeroize(path_secret);
+  for (auto& secret : path_secrets) {
+    zeroize(secret);
   }
 
   return path;
@@ -199,9 +437,12 @@ RatchetTree::encrypt(LeafIndex from, const bytes& leaf_secret) const
 RatchetTree::MergeInfo
 RatchetTree::decrypt(LeafIndex from, const DirectPath& path) const
 {
+  metrics::ScopedTimer timer(metrics::Timer::tree_decrypt);
+
   MergeInfo info;
 
-  auto copath = tree_math::copath(NodeIndex{ from }, node_size());
+  auto table = tree_math::PathTable::get(node_size());
+  const auto& copath = table->copath(NodeIndex{ from });
   if (path.nodes.size() != copath.size() + 1) {
     throw ProtocolError("Malformed DirectPath");
   }
@@ -212,7 +453,16 @@ RatchetTree::decrypt(LeafIndex from, const DirectPath& path) const
   }
   info.public_keys.push_back(path.nodes[0].public_key);
 
-  // Handle the remainder of the path
+  // Handle the remainder of the path.  The public-key checks on the
+  // derived path secrets are deferred, since each one is an
+  // independent key derivation that can run on its own thread.
+  struct KeyCheck
+  {
+    bytes path_secret;
+    DHPublicKey expected;
+  };
+  std::vector<KeyCheck> checks;
+
   bytes path_secret;
   bool have_secret = false;
   for (size_t i = 0; i < copath.size(); ++i) {
@@ -240,47 +490,83 @@ RatchetTree::decrypt(LeafIndex from, const DirectPath& path) const
     }
 
     if (have_secret) {
-      auto temp = new_node(path_secret);
-      if (temp.public_key() != path_node.public_key) {
-        throw InvalidParameterError("Incorrect node public key");
-      }
-
+      checks.push_back({ path_secret, path_node.public_key });
       info.secrets.push_back(path_secret);
     } else {
       info.public_keys.push_back(path_node.public_key);
     }
   }
 
+  auto check_one = [&](const KeyCheck& check) {
+    return new_node(check.path_secret).public_key() == check.expected;
+  };
+
+  auto ok = true;
+  if (!_parallel) {
+    for (const auto& check : checks) {
+      ok = ok && check_one(check);
+    }
+  } else {
+    std::vector<std::future<bool>> futures;
+    futures.reserve(checks.size());
+    for (const auto& check : checks) {
+      futures.emplace_back(
+        std::async(std::launch::async, check_one, std::cref(check)));
+    }
+
+    for (auto& future : futures) {
+      ok = ok && future.get();
+    }
+  }
+
+  for (auto& check : checks) {
+    zeroize(check.path_secret);
+  }
+  zeroize(path_secret);
+
+  if (!ok) {
+    throw InvalidParameterError("Incorrect node public key");
+  }
+
   return info;
 }
 
 void
 RatchetTree::merge_path(LeafIndex from, const RatchetTree::MergeInfo& info)
 {
-  const auto dirpath = tree_math::dirpath(NodeIndex{ from }, node_size());
+  auto table = tree_math::PathTable::get(node_size());
+  const auto& dirpath = table->dirpath(NodeIndex{ from });
   if (dirpath.size() + 1 != info.public_keys.size() + info.secrets.size()) {
     throw InvalidParameterError("Malformed MergeInfo");
   }
 
+  // The root is always set from a recovered secret, so a MergeInfo
+  // with no secrets cannot be applied.  This happens when decrypt ran
+  // on a tree that holds no private keys on the sender's copath,
+  // e.g., one restored without its private key material.
+  if (info.secrets.empty()) {
+    throw ProtocolError("MergeInfo carries no path secrets");
+  }
+
   auto key_list_size = info.public_keys.size();
   for (size_t i = 0; i < dirpath.size(); ++i) {
     auto curr = dirpath[i];
     while (curr.val > _nodes.size() - 1) {
-      _nodes.emplace_back(_suite);
+      _nodes.append_blank();
     }
 
     if (i < info.public_keys.size()) {
       auto node = RatchetTreeNode(info.public_keys[i]);
-      _nodes[curr].merge(node);
+      _nodes.merge(curr, node);
     } else {
       auto node = new_node(info.secrets[i - key_list_size]);
-      _nodes[curr].merge(node);
+      _nodes.merge(curr, node);
     }
   }
 
   auto root = tree_math::root(node_size());
   auto node = new_node(info.secrets.back());
-  _nodes[root].merge(node);
+  _nodes.merge(root, node);
 }
 
 void
@@ -292,13 +578,13 @@ RatchetTree::add_leaf(LeafIndex index, const DHPublicKey& pub)
 
   if (index.val == size()) {
     if (!_nodes.empty()) {
-      _nodes.emplace_back(std::nullopt);
+      _nodes.append_blank();
     }
 
-    _nodes.emplace_back(RatchetTreeNode(pub));
+    _nodes.append(RatchetTreeNode(pub));
   } else {
     auto node = NodeIndex{ index };
-    _nodes[node] = RatchetTreeNode(pub);
+    _nodes.set(node, RatchetTreeNode(pub));
   }
 }
 
@@ -307,13 +593,13 @@ RatchetTree::add_leaf(LeafIndex index, const bytes& leaf_secret)
 {
   if (index.val == size()) {
     if (!_nodes.empty()) {
-      _nodes.emplace_back(std::nullopt);
+      _nodes.append_blank();
     }
 
-    _nodes.emplace_back(new_node(leaf_secret));
+    _nodes.append(new_node(leaf_secret));
   } else {
     auto node = NodeIndex{ index };
-    _nodes[node] = new_node(leaf_secret);
+    _nodes.set(node, new_node(leaf_secret));
   }
 }
 
@@ -325,7 +611,7 @@ RatchetTree::blank_path(LeafIndex index)
 
   auto curr = NodeIndex{ index };
   while (curr != root) {
-    _nodes[curr] = std::nullopt;
+    _nodes.blank(curr);
     curr = tree_math::parent(curr, node_count);
   }
 }
@@ -340,16 +626,21 @@ RatchetTree::set_path(LeafIndex index, const bytes& leaf)
   auto path_secret = leaf;
   while (curr != root) {
     while (curr.val > _nodes.size() - 1) {
-      _nodes.emplace_back(_suite);
+      _nodes.append_blank();
     }
 
-    _nodes[curr] = new_node(path_secret);
-    path_secret = path_step(path_secret);
+    _nodes.set(curr, new_node(path_secret));
+
+    // Scrub each intermediate as soon as the chain has moved past it
+    auto next_secret = path_step(path_secret);
+    zeroize(path_secret);
+    path_secret = std::move(next_secret);
 
     curr = tree_math::parent(curr, node_count);
   }
 
-  _nodes[root] = new_node(path_secret);
+  _nodes.set(root, new_node(path_secret));
+  zeroize(path_secret);
 }
 
 LeafCount
@@ -369,6 +660,34 @@ RatchetTree::truncate(LeafCount leaves)
   _nodes.resize(w.val);
 }
 
+std::map<uint32_t, bytes>
+RatchetTree::dump_private_keys() const
+{
+  std::map<uint32_t, bytes> keys;
+  for (const auto& index : _nodes.private_key_holders()) {
+    keys.emplace(index, _nodes[index]->private_key()->to_bytes());
+  }
+  return keys;
+}
+
+void
+RatchetTree::install_private_keys(const std::map<uint32_t, bytes>& keys)
+{
+  for (const auto& entry : keys) {
+    if (entry.first >= _nodes.size()) {
+      throw InvalidParameterError("Private key for an absent node");
+    }
+
+    auto priv = DHPrivateKey::parse(_suite, entry.second);
+    const auto& node = _nodes[entry.first];
+    if (!node || node->public_key() != priv.public_key()) {
+      throw InvalidParameterError("Private key does not match node");
+    }
+
+    _nodes.merge(NodeIndex{ entry.first }, RatchetTreeNode(priv));
+  }
+}
+
 uint32_t
 RatchetTree::size() const
 {
@@ -387,11 +706,51 @@ RatchetTree::root_secret() const
 {
   auto root = tree_math::root(node_size());
   auto val = _nodes[root]->secret();
-  return *val;
+  return from_secure(*val);
 }
 
 bool
 RatchetTree::check_invariant(LeafIndex from) const
+{
+  // Private-key holders are tracked as the tree is mutated, so only
+  // the direct path and the tracked set need to be examined, instead
+  // of every node in the tree
+  auto dirpath = tree_math::dirpath(NodeIndex{ from }, node_size());
+  dirpath.push_back(tree_math::root(node_size()));
+
+  const auto& holders = _nodes.private_key_holders();
+
+  // Ensure that we have private keys for everything in the direct
+  // path...
+  auto ok = true;
+  for (const auto& node : dirpath) {
+    if (_nodes[node] && holders.count(node.val) == 0) {
+      ok = false;
+    }
+  }
+
+  // ... and nothing else
+  for (const auto& holder : holders) {
+    auto in_dirpath =
+      std::find(dirpath.begin(), dirpath.end(), NodeIndex{ holder }) !=
+      dirpath.end();
+    if (!in_dirpath) {
+      ok = false;
+    }
+  }
+
+#ifndef NDEBUG
+  // Debug builds cross-check the tracked set against the full scan
+  if (ok != scan_invariant(from)) {
+    return false;
+  }
+#endif
+
+  return ok;
+}
+
+bool
+RatchetTree::scan_invariant(LeafIndex from) const
 {
   std::vector<bool> in_dirpath(_nodes.size(), false);
 
@@ -445,6 +804,145 @@ RatchetTree::node_step(const bytes& path_secret) const
   return hkdf_expand_label(_suite, path_secret, "node", {}, _secret_size);
 }
 
+///
+/// Compact encodings
+///
+
+bytes
+RatchetTree::compact() const
+{
+  auto n_nodes = uint32_t(_nodes.size());
+
+  std::vector<uint8_t> bitmap((n_nodes + 7) / 8, 0);
+  std::vector<uint8_t> keys;
+  for (uint32_t i = 0; i < n_nodes; i += 1) {
+    if (!_nodes[i]) {
+      continue;
+    }
+
+    bitmap[i / 8] |= uint8_t(1 << (i % 8));
+    auto key = _nodes[i]->public_key().to_bytes();
+    keys.insert(keys.end(), key.begin(), key.end());
+  }
+
+  tls::ostream out;
+  out << n_nodes << tls::opaque<4>(bitmap) << tls::opaque<4>(keys);
+  return out.bytes();
+}
+
+RatchetTree
+RatchetTree::decompact(CipherSuite suite, const bytes& data)
+{
+  uint32_t n_nodes;
+  tls::opaque<4> bitmap;
+  tls::opaque<4> keys;
+  auto in = tls::istream::ref(data.data(), data.size());
+  in >> n_nodes >> bitmap >> keys;
+
+  if (bitmap.size() != (n_nodes + 7) / 8) {
+    throw ProtocolError("Malformed compact tree bitmap");
+  }
+
+  size_t populated = 0;
+  for (uint32_t i = 0; i < n_nodes; i += 1) {
+    populated += (bitmap[i / 8] >> (i % 8)) & 0x01;
+  }
+
+  if ((populated == 0 && !keys.empty()) ||
+      (populated > 0 && keys.size() % populated != 0)) {
+    throw ProtocolError("Malformed compact tree keys");
+  }
+
+  // All node keys in one tree are the same size, so the keys are
+  // packed without per-key headers
+  auto key_size = (populated == 0) ? size_t(0) : keys.size() / populated;
+
+  RatchetTree tree{ suite };
+  size_t pos = 0;
+  for (uint32_t i = 0; i < n_nodes; i += 1) {
+    tree._nodes.append_blank();
+    if (((bitmap[i / 8] >> (i % 8)) & 0x01) == 0) {
+      continue;
+    }
+
+    bytes key(keys.begin() + pos, keys.begin() + pos + key_size);
+    pos += key_size;
+    tree._nodes.set(NodeIndex{ i }, RatchetTreeNode(DHPublicKey(suite, key)));
+  }
+
+  return tree;
+}
+
+bytes
+RatchetTree::compact_delta(const RatchetTree& prior) const
+{
+  auto n_nodes = uint32_t(_nodes.size());
+  auto n_prior = uint32_t(prior._nodes.size());
+
+  std::vector<uint32_t> changed;
+  for (uint32_t i = 0; i < n_nodes; i += 1) {
+    auto in_prior = (i < n_prior) && bool(prior._nodes[i]);
+    if (bool(_nodes[i]) != in_prior) {
+      changed.push_back(i);
+      continue;
+    }
+
+    if (_nodes[i] && in_prior &&
+        _nodes[i]->public_key() != prior._nodes[i]->public_key()) {
+      changed.push_back(i);
+    }
+  }
+
+  tls::ostream out;
+  out << n_nodes << uint32_t(changed.size());
+  for (const auto i : changed) {
+    // An empty key means the node went blank
+    tls::opaque<2> key;
+    if (_nodes[i]) {
+      key = tls::opaque<2>(_nodes[i]->public_key().to_bytes());
+    }
+
+    out << i << key;
+  }
+
+  return out.bytes();
+}
+
+RatchetTree
+RatchetTree::decompact_delta(const RatchetTree& prior, const bytes& data)
+{
+  uint32_t n_nodes;
+  uint32_t n_changes;
+  auto in = tls::istream::ref(data.data(), data.size());
+  in >> n_nodes >> n_changes;
+
+  auto tree = prior;
+  while (tree._nodes.size() < n_nodes) {
+    tree._nodes.append_blank();
+  }
+  if (tree._nodes.size() > n_nodes) {
+    tree._nodes.resize(n_nodes);
+  }
+
+  for (uint32_t c = 0; c < n_changes; c += 1) {
+    uint32_t index;
+    tls::opaque<2> key;
+    in >> index >> key;
+    if (index >= n_nodes) {
+      throw ProtocolError("Compact tree delta index outside the tree");
+    }
+
+    if (key.empty()) {
+      tree._nodes.blank(NodeIndex{ index });
+    } else {
+      tree._nodes.set(NodeIndex{ index },
+                      RatchetTreeNode(DHPublicKey(prior.cipher_suite(), key)));
+    }
+  }
+
+  return tree;
+}
+
 bool
 operator==(const RatchetTree& lhs, const RatchetTree& rhs)
 {
@@ -471,8 +969,8 @@ operator==(const RatchetTree& lhs, const RatchetTree& rhs)
 std::ostream&
 operator<<(std::ostream& out, const RatchetTree& obj)
 {
-  for (const auto& node : obj._nodes) {
-    out << node << " ";
+  for (uint32_t i = 0; i < obj._nodes.size(); i += 1) {
+    out << obj._nodes[i] << " ";
   }
   return out;
 }
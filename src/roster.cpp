@@ -28,7 +28,7 @@ operator>>(tls::istream& in, CredentialType& type)
 std::unique_ptr<AbstractCredential>
 BasicCredential::dup() const
 {
-  return std::make_unique<BasicCredential>(_identity, _public_key);
+  return std::make_unique<BasicCredential>(*this);
 }
 
 bytes
@@ -40,23 +40,28 @@ BasicCredential::identity() const
 SignaturePublicKey
 BasicCredential::public_key() const
 {
-  return _public_key;
+  std::call_once(_public_key_once, [this]() {
+    if (!_public_key) {
+      _public_key = SignaturePublicKey(_scheme, _key_data);
+    }
+  });
+
+  return *_public_key;
 }
 
 void
 BasicCredential::read(tls::istream& in)
 {
-  SignatureScheme scheme;
-  in >> _identity >> scheme;
-
-  _public_key = SignaturePublicKey(scheme);
-  in >> _public_key;
+  // Only the raw bytes are retained here; the key import is deferred
+  // to the first call to public_key()
+  in >> _identity >> _scheme >> _key_data;
+  _public_key = std::nullopt;
 }
 
 void
 BasicCredential::write(tls::ostream& out) const
 {
-  out << _identity << _public_key.signature_scheme() << _public_key;
+  out << _identity << _scheme << _key_data;
 }
 
 bool
@@ -64,7 +69,8 @@ BasicCredential::equal(const AbstractCredential* other) const
 {
   auto basic_other = dynamic_cast<const BasicCredential*>(other);
   return (_identity == basic_other->_identity) &&
-         (_public_key == basic_other->_public_key);
+         (_scheme == basic_other->_scheme) &&
+         (_key_data == basic_other->_key_data);
 }
 
 ///
@@ -158,6 +164,8 @@ operator>>(tls::istream& in, Credential& obj)
 void
 Roster::add(uint32_t index, const Credential& cred)
 {
+  _enc_cache.erase(index);
+
   if (index == _credentials.size()) {
     _credentials.push_back(cred);
   } else {
@@ -172,10 +180,11 @@ Roster::remove(uint32_t index)
     throw InvalidParameterError("Unknown credential index");
   }
 
+  _enc_cache.erase(index);
   _credentials[index] = std::nullopt;
 }
 
-Credential
+const Credential&
 Roster::get(uint32_t index) const
 {
   if (!_credentials[index]) {
@@ -185,6 +194,12 @@ Roster::get(uint32_t index) const
   return *_credentials[index];
 }
 
+bool
+Roster::has(uint32_t index) const
+{
+  return (index < _credentials.size()) && bool(_credentials[index]);
+}
+
 size_t
 Roster::size() const
 {
@@ -194,9 +209,22 @@ Roster::size() const
 void
 Roster::truncate(uint32_t size)
 {
+  _enc_cache.erase(_enc_cache.lower_bound(size), _enc_cache.end());
   _credentials.resize(size);
 }
 
+const bytes&
+Roster::credential_encoding(uint32_t index) const
+{
+  auto cached = _enc_cache.find(index);
+  if (cached != _enc_cache.end()) {
+    return cached->second;
+  }
+
+  auto encoding = tls::marshal(_credentials[index]);
+  return _enc_cache.emplace(index, std::move(encoding)).first->second;
+}
+
 bool
 operator==(const Roster& lhs, const Roster& rhs)
 {
@@ -206,12 +234,27 @@ operator==(const Roster& lhs, const Roster& rhs)
 tls::ostream&
 operator<<(tls::ostream& out, const Roster& obj)
 {
-  return out << obj._credentials;
+  // Assembled from cached per-slot encodings; only credentials that
+  // changed since the last marshal are re-encoded
+  size_t total = 0;
+  for (uint32_t i = 0; i < obj._credentials.size(); i += 1) {
+    total += obj.credential_encoding(i).size();
+  }
+
+  tls::vector<uint8_t, 4> data;
+  data.reserve(total);
+  for (uint32_t i = 0; i < obj._credentials.size(); i += 1) {
+    const auto& encoding = obj.credential_encoding(i);
+    data.insert(data.end(), encoding.begin(), encoding.end());
+  }
+
+  return out << data;
 }
 
 tls::istream&
 operator>>(tls::istream& in, Roster& obj)
 {
+  obj._enc_cache.clear();
   return in >> obj._credentials;
 }
 
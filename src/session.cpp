@@ -17,6 +17,12 @@ Session::Session(CipherList supported_ciphersuites,
   make_init_key();
 }
 
+Session::Session(SignaturePrivateKey identity_priv, Credential credential)
+  : _identity_priv(std::move(identity_priv))
+  , _credential(std::move(credential))
+  , _current_epoch(0)
+{}
+
 bool
 operator==(const Session& lhs, const Session& rhs)
 {
@@ -110,11 +116,124 @@ Session::join(const bytes& welcome_data, const bytes& add_data)
 void
 Session::handle(const bytes& handshake_data)
 {
-  Handshake handshake{ current_state().cipher_suite() };
-  tls::unmarshal(handshake_data, handshake);
+  commit(prepare(handshake_data));
+}
 
-  auto next = current_state().handle(handshake);
-  add_state(handshake.prior_epoch, next);
+Session::PendingHandshake
+Session::prepare(const bytes& handshake_data) const
+{
+  // Identical deliveries of the same broadcast (one per member hosted
+  // in this process) reuse the parse from the first arrival
+  auto handshake =
+    HandshakeCache::parse(current_state().cipher_suite(), handshake_data);
+
+  auto next = current_state().handle(*handshake);
+  return PendingHandshake{ handshake->prior_epoch, next };
+}
+
+void
+Session::commit(const PendingHandshake& pending)
+{
+  add_state(pending.prior_epoch, pending.next);
+}
+
+std::future<Session::PendingHandshake>
+Session::handle_async(const bytes& handshake_data) const
+{
+  // Copy the current state here, on the calling thread, so that the
+  // worker does not touch the live session.  State copies share only
+  // the lazily-filled key caches, whose fills are synchronized.
+  auto state = current_state();
+  return std::async(
+    std::launch::async, [state = std::move(state), handshake_data]() {
+      auto handshake =
+        HandshakeCache::parse(state.cipher_suite(), handshake_data);
+      auto next = state.handle(*handshake);
+      return PendingHandshake{ handshake->prior_epoch, next };
+    });
+}
+
+static const uint8_t session_snapshot_version = 1;
+
+bytes
+Session::save() const
+{
+  tls::ostream out;
+  out << session_snapshot_version;
+  out << tls::vector<CipherSuite, 1>(_supported_ciphersuites);
+  out << tls::opaque<1>(_init_secret) << _user_init_key;
+  out << _identity_priv.signature_scheme()
+      << tls::opaque<2>(_identity_priv.to_bytes());
+  out << _credential << _current_epoch;
+
+  // Each state is framed as an opaque blob, so that a reader can
+  // index the epochs without parsing them
+  tls::vector<tls::opaque<4>, 4> states;
+  states.reserve(_state.size());
+  for (const auto& entry : _state) {
+    states.emplace_back(entry.second.snapshot());
+  }
+  out << states;
+
+  return out.bytes();
+}
+
+Session
+Session::restore(const bytes& data)
+{
+  auto in = tls::istream::ref(data.data(), data.size());
+
+  uint8_t version;
+  in >> version;
+  if (version != session_snapshot_version) {
+    throw ProtocolError("Unsupported session snapshot version");
+  }
+
+  tls::vector<CipherSuite, 1> suites;
+  tls::opaque<1> init_secret;
+  tls::opaque<2> user_init_key;
+  SignatureScheme scheme;
+  tls::opaque<2> identity_priv_data;
+  in >> suites >> init_secret >> user_init_key >> scheme >> identity_priv_data;
+
+  auto identity_priv = SignaturePrivateKey::parse(scheme, identity_priv_data);
+
+  Credential credential;
+  in >> credential;
+
+  Session session{ std::move(identity_priv), std::move(credential) };
+  session._supported_ciphersuites = suites;
+  session._init_secret = init_secret;
+  session._user_init_key = user_init_key;
+  in >> session._current_epoch;
+
+  tls::vector<tls::opaque<4>, 4> states;
+  in >> states;
+  for (const auto& state_data : states) {
+    auto state = State::restore(state_data);
+    session._state.emplace(state.epoch(), state);
+  }
+
+  return session;
+}
+
+void
+Session::set_retention(size_t max_epochs)
+{
+  _max_epochs = max_epochs;
+  prune();
+}
+
+void
+Session::set_eviction_handler(EvictionHandler handler)
+{
+  _on_evict = std::move(handler);
+}
+
+size_t
+Session::resident_epochs() const
+{
+  return _state.size();
 }
 
 void
@@ -145,6 +264,29 @@ Session::add_state(epoch_t prior_epoch, const State& state)
   if (prior_epoch == _current_epoch || _state.size() == 1) {
     _current_epoch = state.epoch();
   }
+
+  prune();
+}
+
+void
+Session::prune()
+{
+  if (_max_epochs == 0) {
+    return;
+  }
+
+  while (_state.size() > _max_epochs) {
+    auto oldest = _state.begin();
+    if (oldest->first == _current_epoch) {
+      break;
+    }
+
+    if (_on_evict) {
+      _on_evict(oldest->first, oldest->second);
+    }
+
+    _state.erase(oldest);
+  }
 }
 
 const State&
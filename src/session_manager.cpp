@@ -0,0 +1,203 @@
+#include "session_manager.h"
+#include "common.h"
+
+namespace mls {
+
+SessionManager::SessionManager()
+  : SessionManager(std::thread::hardware_concurrency())
+{}
+
+SessionManager::SessionManager(size_t n_workers)
+  : _runnable((n_workers == 0) ? 1 : n_workers)
+{
+  _workers.reserve(_runnable.size());
+  for (size_t i = 0; i < _runnable.size(); i += 1) {
+    _workers.emplace_back([this, i]() { worker(i); });
+  }
+}
+
+SessionManager::~SessionManager()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _running = false;
+  }
+
+  _work.notify_all();
+  for (auto& thread : _workers) {
+    thread.join();
+  }
+}
+
+void
+SessionManager::add_session(const bytes& group_id, Session session)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  _groups.emplace(group_id, Group{ std::move(session) });
+}
+
+void
+SessionManager::remove_session(const bytes& group_id)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  auto entry = _groups.find(group_id);
+  if (entry == _groups.end()) {
+    return;
+  }
+
+  // Let any submitted messages drain first
+  _idle.wait(lock, [&]() { return !entry->second.scheduled; });
+  _in_flight -= entry->second.pending.size();
+  _groups.erase(entry);
+}
+
+void
+SessionManager::with_session(const bytes& group_id,
+                             const std::function<void(Session&)>& function)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  auto entry = _groups.find(group_id);
+  if (entry == _groups.end()) {
+    throw MissingStateError("No session for group");
+  }
+
+  _idle.wait(lock, [&]() { return !entry->second.scheduled; });
+  function(entry->second.session);
+}
+
+uint64_t
+SessionManager::submit(const bytes& group_id, const bytes& handshake_data)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto entry = _groups.find(group_id);
+  if (entry == _groups.end()) {
+    throw MissingStateError("No session for group");
+  }
+
+  auto ticket = _next_ticket;
+  _next_ticket += 1;
+  entry->second.pending.push_back({ ticket, handshake_data });
+  _in_flight += 1;
+
+  if (!entry->second.scheduled) {
+    entry->second.scheduled = true;
+    _runnable[home_worker(group_id)].push_back(group_id);
+    _work.notify_one();
+  }
+
+  return ticket;
+}
+
+std::vector<SessionManager::Result>
+SessionManager::poll()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto results = std::move(_results);
+  _results.clear();
+  return results;
+}
+
+void
+SessionManager::flush()
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _idle.wait(lock, [&]() { return _in_flight == 0; });
+}
+
+size_t
+SessionManager::size() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _groups.size();
+}
+
+size_t
+SessionManager::home_worker(const bytes& group_id) const
+{
+  // FNV-1a over the group ID
+  uint64_t hash = 0xcbf29ce484222325;
+  for (const auto& byte : group_id) {
+    hash = (hash ^ byte) * 0x100000001b3;
+  }
+
+  return hash % _runnable.size();
+}
+
+void
+SessionManager::worker(size_t index)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (_running) {
+    // Take the next runnable group, preferring this worker's own
+    // queue and stealing from the back of the others' queues when it
+    // is empty
+    bytes group_id;
+    auto found = false;
+    for (size_t i = 0; i < _runnable.size() && !found; i += 1) {
+      auto& queue = _runnable[(index + i) % _runnable.size()];
+      if (queue.empty()) {
+        continue;
+      }
+
+      if (i == 0) {
+        group_id = queue.front();
+        queue.pop_front();
+      } else {
+        group_id = queue.back();
+        queue.pop_back();
+      }
+
+      found = true;
+    }
+
+    if (!found) {
+      _work.wait(lock);
+      continue;
+    }
+
+    auto entry = _groups.find(group_id);
+    if (entry == _groups.end()) {
+      continue;
+    }
+
+    auto& group = entry->second;
+    auto batch = std::move(group.pending);
+    group.pending.clear();
+
+    // Process the batch outside the lock; the scheduled flag keeps
+    // other workers (and removal) away from this group
+    lock.unlock();
+    std::vector<Result> results;
+    results.reserve(batch.size());
+    for (const auto& message : batch) {
+      auto result = Result{ message.ticket, group_id, true, "" };
+      try {
+        group.session.handle(message.data);
+      } catch (const std::exception& error) {
+        result.ok = false;
+        result.error = error.what();
+      }
+
+      results.push_back(std::move(result));
+    }
+
+    lock.lock();
+    for (auto& result : results) {
+      _results.push_back(std::move(result));
+    }
+    _in_flight -= batch.size();
+
+    // Messages that arrived while we were processing put the group
+    // back on this worker's queue
+    if (!group.pending.empty()) {
+      _runnable[index].push_back(group_id);
+      _work.notify_one();
+    } else {
+      group.scheduled = false;
+    }
+
+    _idle.notify_all();
+  }
+}
+
+} // namespace mls
@@ -1,7 +1,91 @@
 #include "state.h"
+#include "metrics.h"
+#include <mutex>
 
 namespace mls {
 
+///
+/// HandshakeCache
+///
+
+namespace {
+
+const size_t max_cached_parses = 64;
+const size_t max_cached_signatures = 256;
+
+std::mutex handshake_cache_mutex;
+std::map<bytes, std::shared_ptr<const Handshake>> parse_cache;
+std::map<bytes, bool> signature_cache;
+
+} // namespace
+
+std::shared_ptr<const Handshake>
+HandshakeCache::parse(CipherSuite suite, const bytes& encoded)
+{
+  auto key = Digest(DigestType::SHA256)
+               .write(tls::marshal(suite))
+               .write(encoded)
+               .digest();
+
+  {
+    std::lock_guard<std::mutex> lock(handshake_cache_mutex);
+    auto hit = parse_cache.find(key);
+    if (hit != parse_cache.end()) {
+      return hit->second;
+    }
+  }
+
+  // Parse outside the lock
+  auto handshake = std::make_shared<Handshake>(suite);
+  tls::unmarshal(encoded, *handshake);
+
+  std::lock_guard<std::mutex> lock(handshake_cache_mutex);
+  if (parse_cache.size() >= max_cached_parses) {
+    parse_cache.clear();
+  }
+
+  return parse_cache.emplace(key, std::move(handshake)).first->second;
+}
+
+bool
+HandshakeCache::check_signature(const SignaturePublicKey& pub,
+                                const bytes& message,
+                                const bytes& signature)
+{
+  // The fields are length-framed so that the key is an unambiguous
+  // encoding of the verification inputs
+  tls::ostream content;
+  content << pub.signature_scheme() << tls::opaque<2>(pub.to_bytes())
+          << tls::opaque<4>(message) << tls::opaque<2>(signature);
+  auto key = Digest(DigestType::SHA256).write(content.bytes()).digest();
+
+  {
+    std::lock_guard<std::mutex> lock(handshake_cache_mutex);
+    auto hit = signature_cache.find(key);
+    if (hit != signature_cache.end()) {
+      return hit->second;
+    }
+  }
+
+  auto valid = pub.verify(message, signature);
+
+  std::lock_guard<std::mutex> lock(handshake_cache_mutex);
+  if (signature_cache.size() >= max_cached_signatures) {
+    signature_cache.clear();
+  }
+
+  signature_cache.emplace(key, valid);
+  return valid;
+}
+
+void
+HandshakeCache::reset()
+{
+  std::lock_guard<std::mutex> lock(handshake_cache_mutex);
+  parse_cache.clear();
+  signature_cache.clear();
+}
+
 ///
 /// GroupState
 ///
@@ -13,7 +97,7 @@ GroupState::GroupState(const bytes& group_id,
   : group_id(group_id)
   , epoch(0)
   , tree(suite, leaf_secret)
-  , transcript_hash(Digest(suite).output_size(), 0)
+  , transcript_hash(suite_digest_size(suite), 0)
 {
   roster.add(0, credential);
 }
@@ -67,23 +151,92 @@ const char* ApplicationKeyChain::_key_label = "key";
 ApplicationKeyChain::KeyAndNonce
 ApplicationKeyChain::get(uint32_t generation) const
 {
+  if (_ratcheting) {
+    return get_ratcheting(generation);
+  }
+
+  auto cached = _cache.find(generation);
+  if (cached != _cache.end()) {
+    return cached->second;
+  }
+
+  // Start from the closest secret at or before the requested
+  // generation: the frontier if it hasn't passed the target,
+  // otherwise the nearest cache entry, otherwise the base secret
+  uint32_t start = 0;
   auto secret = _base_secret;
-  for (uint32_t i = 0; i < generation; ++i) {
-    secret = derive(secret, _secret_label, _secret_size);
+  if (generation >= _next_generation) {
+    start = _next_generation;
+    secret = _next_secret;
+  } else {
+    auto prior = _cache.upper_bound(generation);
+    if (prior != _cache.begin()) {
+      prior--;
+      start = prior->first;
+      secret = to_secure(prior->second.secret);
+    }
+  }
+
+  for (uint32_t i = start; i < generation; ++i) {
+    secret = derive(secret);
+  }
+
+  if (generation >= _next_generation) {
+    _next_generation = generation;
+    _next_secret = secret;
   }
 
-  auto key = hkdf_expand_label(_suite, secret, _key_label, {}, _key_size);
-  auto nonce = hkdf_expand_label(_suite, secret, _nonce_label, {}, _nonce_size);
+  auto secret_out = from_secure(secret);
+  auto key = _key_tmpl.expand(_suite, secret_out, {});
+  auto nonce = _nonce_tmpl.expand(_suite, secret_out, {});
 
+  auto key_and_nonce = KeyAndNonce{ secret_out, key, nonce };
+  _cache.emplace(generation, key_and_nonce);
+  if (_cache.size() > _max_cache_size) {
+    _cache.erase(_cache.begin());
+  }
+
+  return key_and_nonce;
+}
+
+ApplicationKeyChain::KeyAndNonce
+ApplicationKeyChain::get_ratcheting(uint32_t generation) const
+{
+  if (generation < _window_floor) {
+    throw ProtocolError("Generation is behind the retention window");
+  }
+
+  // Advance the frontier through the requested generation, retaining
+  // secrets for not-yet-requested generations in the window, then
+  // slide the window floor forward and delete everything behind it
+  if (generation >= _next_generation) {
+    while (_next_generation <= generation) {
+      _window.emplace(_next_generation, _next_secret);
+      _next_secret = derive(_next_secret);
+      _next_generation += 1;
+    }
+
+    if (_next_generation > _window_size) {
+      _window_floor = _next_generation - _window_size;
+      _window.erase(_window.begin(), _window.lower_bound(_window_floor));
+    }
+  }
+
+  auto entry = _window.find(generation);
+  if (entry == _window.end()) {
+    throw ProtocolError("Generation is behind the retention window");
+  }
+
+  auto secret = from_secure(entry->second);
+  auto key = _key_tmpl.expand(_suite, secret, {});
+  auto nonce = _nonce_tmpl.expand(_suite, secret, {});
   return KeyAndNonce{ secret, key, nonce };
 }
 
-bytes
-ApplicationKeyChain::derive(const bytes& secret,
-                            const std::string& label,
-                            const size_t size) const
+secure_bytes
+ApplicationKeyChain::derive(const secure_bytes& secret) const
 {
-  return hkdf_expand_label(_suite, secret, label, _sender, size);
+  return to_secure(_secret_tmpl.expand(_suite, from_secure(secret), _sender));
 }
 
 ///
@@ -97,10 +250,10 @@ State::State(const bytes& group_id,
              const Credential& credential)
   : _suite(suite)
   , _state(group_id, suite, leaf_secret, credential)
-  , _init_secret(zero_bytes(32))
+  , _init_secret(to_secure(zero_bytes(32)))
   , _index(0)
   , _identity_priv(std::move(identity_priv))
-  , _zero(Digest(suite).output_size(), 0)
+  , _zero(suite_digest_size(suite), 0)
 {}
 
 State::State(SignaturePrivateKey identity_priv,
@@ -112,19 +265,45 @@ State::State(SignaturePrivateKey identity_priv,
   , _state(welcome.cipher_suite)
   , _identity_priv(std::move(identity_priv))
 {
-  // Verify that we have an add and it is for us
-  if (handshake.operation.type != GroupOperationType::add) {
+  // Verify that we have an add and locate our entry in it
+  const auto& operation = handshake.operation;
+  auto type = operation.type;
+  if (type != GroupOperationType::add && type != GroupOperationType::bulk_add) {
     throw InvalidParameterError("Incorrect handshake type");
   }
 
-  auto add = handshake.operation.add;
-  if (credential != add.init_key.credential) {
-    throw InvalidParameterError("Add not targeted for this node");
+  LeafIndex my_index;
+  const UserInitKey* my_init_key = nullptr;
+  bytes welcome_info_hash;
+  if (type == GroupOperationType::add) {
+    const auto& add = operation.add;
+    if (credential != add.init_key.credential) {
+      throw InvalidParameterError("Add not targeted for this node");
+    }
+
+    my_index = add.index;
+    my_init_key = &add.init_key;
+    welcome_info_hash = add.welcome_info_hash;
+  } else {
+    const auto& bulk_add = operation.bulk_add;
+    for (uint32_t i = 0; i < bulk_add.init_keys.size(); i += 1) {
+      if (credential == bulk_add.init_keys[i].credential) {
+        my_index = LeafIndex{ bulk_add.index.val + i };
+        my_init_key = &bulk_add.init_keys[i];
+        break;
+      }
+    }
+
+    if (my_init_key == nullptr) {
+      throw InvalidParameterError("Add not targeted for this node");
+    }
+
+    welcome_info_hash = bulk_add.welcome_info_hash;
   }
 
   // Make sure that the init key for the chosen ciphersuite is the
   // one we sent
-  auto init_uik = add.init_key.find_init_key(_suite);
+  auto init_uik = my_init_key->find_init_key(_suite);
   if (!init_uik) {
     throw ProtocolError("Selected cipher suite not supported");
   }
@@ -138,25 +317,43 @@ State::State(SignaturePrivateKey identity_priv,
   auto welcome_info = welcome.decrypt(init_priv);
 
   // Make sure the WelcomeInfo matches the Add
-  if (add.welcome_info_hash != welcome_info.hash(_suite)) {
+  if (welcome_info_hash != welcome_info.hash(_suite)) {
     throw ProtocolError("Mismatch in welcome info hash");
   }
 
   // Ingest the WelcomeInfo
   _state = GroupState{ welcome_info };
 
-  _init_secret = welcome_info.init_secret;
-  _zero = bytes(Digest(_suite).output_size(), 0);
+  _init_secret = to_secure(welcome_info.init_secret);
+  _zero = bytes(suite_digest_size(_suite), 0);
 
   // Add to the transcript hash
   update_transcript_hash(handshake.operation);
 
-  // Add to the tree
-  _index = add.index;
-  _state.tree.add_leaf(_index, init_secret);
+  // Add the whole batch to the tree and roster; we know our own leaf
+  // secret, and only the public init keys of the other new members
+  _index = my_index;
+  if (type == GroupOperationType::add) {
+    _state.tree.add_leaf(_index, init_secret);
+    _state.roster.add(_index.val, credential);
+  } else {
+    const auto& bulk_add = operation.bulk_add;
+    for (uint32_t i = 0; i < bulk_add.init_keys.size(); i += 1) {
+      auto where = LeafIndex{ bulk_add.index.val + i };
+      if (where == _index) {
+        _state.tree.add_leaf(where, init_secret);
+      } else {
+        auto pub = bulk_add.init_keys[i].find_init_key(_suite);
+        if (!pub) {
+          throw ProtocolError("New node does not support group's cipher suite");
+        }
+
+        _state.tree.add_leaf(where, *pub);
+      }
 
-  // Add to the roster
-  _state.roster.add(_index.val, credential);
+      _state.roster.add(where.val, bulk_add.init_keys[i].credential);
+    }
+  }
 
   // Ratchet forward into shared state
   update_epoch_secrets(_zero);
@@ -166,6 +363,13 @@ State::State(SignaturePrivateKey identity_priv,
   }
 }
 
+State::State(CipherSuite suite, SignaturePrivateKey identity_priv)
+  : _suite(suite)
+  , _state(suite)
+  , _identity_priv(std::move(identity_priv))
+  , _zero(suite_digest_size(suite), 0)
+{}
+
 State::InitialInfo
 State::negotiate(const bytes& group_id,
                  const std::vector<CipherSuite> supported_ciphersuites,
@@ -235,11 +439,46 @@ State::add(uint32_t index, const UserInitKey& user_init_key) const
   return std::pair<Welcome, Handshake>(welcome, add);
 }
 
+std::pair<std::vector<Welcome>, Handshake>
+State::add(const std::vector<UserInitKey>& user_init_keys) const
+{
+  // Serialize and hash the WelcomeInfo once for the whole batch; each
+  // member gets the same info encrypted to their own init key
+  auto welcome_info_str = welcome_info();
+  auto welcome_info_data = tls::marshal(welcome_info_str);
+  auto welcome_info_hash = welcome_info_str.hash(_suite);
+
+  std::vector<Welcome> welcomes;
+  welcomes.reserve(user_init_keys.size());
+  for (const auto& user_init_key : user_init_keys) {
+    if (!user_init_key.verify()) {
+      throw InvalidParameterError("bad signature on user init key");
+    }
+
+    auto pub = user_init_key.find_init_key(_suite);
+    if (!pub) {
+      throw ProtocolError(
+        "New member does not support the group's ciphersuite");
+    }
+
+    Welcome welcome;
+    welcome.user_init_key_id = user_init_key.user_init_key_id;
+    welcome.cipher_suite = _suite;
+    welcome.encrypted_welcome_info = pub->encrypt(welcome_info_data);
+    welcomes.emplace_back(std::move(welcome));
+  }
+
+  auto index = LeafIndex{ _state.tree.size() };
+  auto bulk_add =
+    sign(BulkAdd{ index, user_init_keys, welcome_info_hash });
+  return std::pair<std::vector<Welcome>, Handshake>(welcomes, bulk_add);
+}
+
 Handshake
 State::update(const bytes& leaf_secret)
 {
   auto path = _state.tree.encrypt(_index, leaf_secret);
-  _cached_leaf_secret = leaf_secret;
+  _cached_leaf_secret = to_secure(leaf_secret);
   return sign(Update{ path });
 }
 
@@ -261,6 +500,9 @@ State::remove(const bytes& evict_secret, uint32_t index) const
 State
 State::handle(const Handshake& handshake) const
 {
+  metrics::ScopedTimer timer(metrics::Timer::handshake_handle);
+  metrics::count(metrics::Counter::handshakes_handled);
+
   if (handshake.prior_epoch != _state.epoch) {
     throw InvalidParameterError("Epoch mismatch");
   }
@@ -274,28 +516,90 @@ State::handle(const Handshake& handshake) const
   return next;
 }
 
+State
+State::handle_batch(const std::vector<Handshake>& handshakes) const
+{
+  // Apply the whole run to a single working copy, so that the tree
+  // and roster are mutated in place rather than deep-copied once per
+  // message.  The epoch secrets still have to be derived at every
+  // step, since each epoch's init secret feeds the next and the
+  // confirmation MAC is checked against the evolving key schedule.
+  metrics::count(metrics::Counter::handshakes_handled, handshakes.size());
+
+  auto next = *this;
+  for (const auto& handshake : handshakes) {
+    if (handshake.prior_epoch != next._state.epoch) {
+      throw InvalidParameterError("Epoch mismatch");
+    }
+
+    next.apply(handshake.signer_index, handshake.operation);
+
+    if (!next.verify(handshake)) {
+      throw InvalidParameterError("Invalid handshake message signature");
+    }
+  }
+
+  return next;
+}
+
+bool
+State::verify_batch(const std::vector<Handshake>& handshakes) const
+{
+  // Each signature covers the transcript hash after its operation,
+  // which we can compute by chaining hashes forward without applying
+  // the operations themselves
+  auto transcript = _state.transcript_hash;
+  auto epoch = _state.epoch;
+
+  std::vector<SignatureBatchItem> items;
+  items.reserve(handshakes.size());
+  for (const auto& handshake : handshakes) {
+    if (handshake.prior_epoch != epoch) {
+      return false;
+    }
+    epoch += 1;
+
+    auto operation_bytes = tls::marshal(handshake.operation);
+    transcript =
+      Digest(_suite).write(transcript).write(operation_bytes).digest();
+
+    auto pub = _state.roster.get(handshake.signer_index.val).public_key();
+    items.push_back({ pub, transcript, handshake.signature });
+  }
+
+  return mls::verify_batch(items);
+}
+
 State
 State::handle(LeafIndex signer_index, const GroupOperation& operation) const
 {
   auto next = *this;
+  next.apply(signer_index, operation);
+  return next;
+}
+
+void
+State::apply(LeafIndex signer_index, const GroupOperation& operation)
+{
   bytes update_secret;
   switch (operation.type) {
     case GroupOperationType::add:
-      update_secret = next.handle(operation.add);
+      update_secret = handle(operation.add);
       break;
     case GroupOperationType::update:
-      update_secret = next.handle(signer_index, operation.update);
+      update_secret = handle(signer_index, operation.update);
       break;
     case GroupOperationType::remove:
-      update_secret = next.handle(operation.remove);
+      update_secret = handle(operation.remove);
+      break;
+    case GroupOperationType::bulk_add:
+      update_secret = handle(operation.bulk_add);
       break;
   }
 
-  next.update_transcript_hash(operation);
-  next._state.epoch = _state.epoch + 1;
-  next.update_epoch_secrets(update_secret);
-
-  return next;
+  update_transcript_hash(operation);
+  _state.epoch += 1;
+  update_epoch_secrets(update_secret);
 }
 
 bytes
@@ -332,6 +636,42 @@ State::handle(const Add& add)
   return _zero;
 }
 
+bytes
+State::handle(const BulkAdd& bulk_add)
+{
+  // Verify the WelcomeInfo hash once for the whole batch
+  if (bulk_add.welcome_info_hash != welcome_info().hash(_suite)) {
+    throw ProtocolError("Mismatch in welcome info hash");
+  }
+
+  // The batch occupies consecutive leaves starting at the indicated
+  // index
+  auto index = bulk_add.index;
+  for (const auto& init_key : bulk_add.init_keys) {
+    if (!init_key.verify()) {
+      throw InvalidParameterError("Invalid signature on init key in group add");
+    }
+
+    if (index.val > _state.tree.size()) {
+      throw InvalidParameterError("Invalid leaf index");
+    }
+    if (index.val < _state.tree.size() && _state.tree.occupied(index)) {
+      throw InvalidParameterError("Leaf is not available for add");
+    }
+
+    auto pub = init_key.find_init_key(_suite);
+    if (!pub) {
+      throw ProtocolError("New node does not support group's cipher suite");
+    }
+
+    _state.tree.add_leaf(index, *pub);
+    _state.roster.add(index.val, init_key.credential);
+    index.val += 1;
+  }
+
+  return _zero;
+}
+
 bytes
 State::handle(LeafIndex index, const Update& update)
 {
@@ -341,7 +681,8 @@ State::handle(LeafIndex index, const Update& update)
       throw InvalidParameterError("Got self-update without generating one");
     }
 
-    leaf_secret = _cached_leaf_secret;
+    leaf_secret = from_secure(_cached_leaf_secret);
+    zeroize(_cached_leaf_secret);
     _cached_leaf_secret.clear();
   }
 
@@ -363,6 +704,95 @@ State::handle(const Remove& remove)
   return update_secret;
 }
 
+///
+/// Persistence
+///
+
+static const uint8_t state_snapshot_version = 1;
+
+bytes
+State::snapshot() const
+{
+  tls::ostream out;
+  out << state_snapshot_version << _suite << _identity_priv.signature_scheme()
+      << tls::opaque<2>(_identity_priv.to_bytes()) << _state
+      << tls::opaque<1>(from_secure(_epoch_secret))
+      << tls::opaque<1>(from_secure(_application_secret))
+      << tls::opaque<1>(from_secure(_confirmation_key))
+      << tls::opaque<1>(from_secure(_init_secret)) << _index
+      << tls::opaque<1>(from_secure(_cached_leaf_secret));
+
+  // The tree inside _state marshals public keys only.  Persist this
+  // participant's node private keys alongside it; without them a
+  // restored state cannot decrypt any handshake's direct path.
+  auto tree_priv = _state.tree.dump_private_keys();
+  out << uint32_t(tree_priv.size());
+  for (auto& entry : tree_priv) {
+    out << entry.first << tls::opaque<2>(entry.second);
+    zeroize(entry.second);
+  }
+
+  return out.bytes();
+}
+
+State
+State::restore(const bytes& data)
+{
+  auto in = tls::istream::ref(data.data(), data.size());
+
+  uint8_t version;
+  in >> version;
+  if (version != state_snapshot_version) {
+    throw ProtocolError("Unsupported state snapshot version");
+  }
+
+  CipherSuite suite;
+  SignatureScheme scheme;
+  tls::opaque<2> identity_priv_data;
+  in >> suite >> scheme >> identity_priv_data;
+
+  auto identity_priv = SignaturePrivateKey::parse(scheme, identity_priv_data);
+  auto state = State{ suite, std::move(identity_priv) };
+
+  tls::opaque<1> epoch_secret;
+  tls::opaque<1> application_secret;
+  tls::opaque<1> confirmation_key;
+  tls::opaque<1> init_secret;
+  tls::opaque<1> cached_leaf_secret;
+  in >> state._state >> epoch_secret >> application_secret >>
+    confirmation_key >> init_secret >> state._index >> cached_leaf_secret;
+
+  state._epoch_secret = to_secure(epoch_secret);
+  state._application_secret = to_secure(application_secret);
+  state._confirmation_key = to_secure(confirmation_key);
+  state._init_secret = to_secure(init_secret);
+  state._cached_leaf_secret = to_secure(cached_leaf_secret);
+
+  zeroize(epoch_secret);
+  zeroize(application_secret);
+  zeroize(confirmation_key);
+  zeroize(init_secret);
+  zeroize(cached_leaf_secret);
+
+  uint32_t n_tree_priv;
+  in >> n_tree_priv;
+  std::map<uint32_t, bytes> tree_priv;
+  for (uint32_t i = 0; i < n_tree_priv; i += 1) {
+    uint32_t node_index;
+    tls::opaque<2> priv_data;
+    in >> node_index >> priv_data;
+    tree_priv.emplace(node_index, priv_data);
+    zeroize(priv_data);
+  }
+
+  state._state.tree.install_private_keys(tree_priv);
+  for (auto& entry : tree_priv) {
+    zeroize(entry.second);
+  }
+
+  return state;
+}
+
 State::EpochSecrets
 State::derive_epoch_secrets(CipherSuite suite,
                             const bytes& init_secret,
@@ -406,8 +836,12 @@ operator!=(const State& lhs, const State& rhs)
 WelcomeInfo
 State::welcome_info() const
 {
-  return { _state.group_id, _state.epoch,           _state.roster,
-           _state.tree,     _state.transcript_hash, _init_secret };
+  return { _state.group_id,
+           _state.epoch,
+           _state.roster,
+           _state.tree,
+           _state.transcript_hash,
+           from_secure(_init_secret) };
 }
 
 void
@@ -438,12 +872,18 @@ State::update_leaf(LeafIndex index,
 void
 State::update_epoch_secrets(const bytes& update_secret)
 {
-  auto secrets =
-    derive_epoch_secrets(_suite, _init_secret, update_secret, _state);
-  _epoch_secret = secrets.epoch_secret;
-  _application_secret = secrets.application_secret;
-  _confirmation_key = secrets.confirmation_key;
-  _init_secret = secrets.init_secret;
+  auto secrets = derive_epoch_secrets(
+    _suite, from_secure(_init_secret), update_secret, _state);
+  _epoch_secret = to_secure(secrets.epoch_secret);
+  _application_secret = to_secure(secrets.application_secret);
+  _confirmation_key = to_secure(secrets.confirmation_key);
+  _init_secret = to_secure(secrets.init_secret);
+
+  // Scrub the transient copies
+  zeroize(secrets.epoch_secret);
+  zeroize(secrets.application_secret);
+  zeroize(secrets.confirmation_key);
+  zeroize(secrets.init_secret);
 }
 
 Handshake
@@ -455,7 +895,7 @@ State::sign(const GroupOperation& operation) const
   auto sig = _identity_priv.sign(sig_data);
 
   auto confirm_data = sig_data + sig;
-  auto confirm = hmac(_suite, next._confirmation_key, confirm_data);
+  auto confirm = hmac(_suite, from_secure(next._confirmation_key), confirm_data);
 
   return Handshake{ _state.epoch, operation, _index, sig, confirm };
 }
@@ -466,10 +906,13 @@ State::verify(const Handshake& handshake) const
   auto pub = _state.roster.get(handshake.signer_index.val).public_key();
   auto sig_data = _state.transcript_hash;
   auto sig = handshake.signature;
-  auto sig_ver = pub.verify(sig_data, sig);
+
+  // Re-deliveries of the same broadcast message to other members
+  // hosted in this process reuse the first verification
+  auto sig_ver = HandshakeCache::check_signature(pub, sig_data, sig);
 
   auto confirm_data = sig_data + sig;
-  auto confirm = hmac(_suite, _confirmation_key, confirm_data);
+  auto confirm = hmac(_suite, from_secure(_confirmation_key), confirm_data);
   auto confirm_ver = constant_time_eq(confirm, handshake.confirmation);
 
   return sig_ver && confirm_ver;
@@ -5,18 +5,51 @@ namespace tls {
 void
 ostream::write_raw(const std::vector<uint8_t>& bytes)
 {
+  append(bytes.data(), bytes.size());
+}
+
+size_t
+ostream::size() const
+{
+  if (_counting || (_extern != nullptr)) {
+    return _written;
+  }
+
+  return _buffer.size();
+}
+
+void
+ostream::append(const uint8_t* data, size_t size)
+{
+  if (_counting) {
+    _written += size;
+    return;
+  }
+
+  if (_extern != nullptr) {
+    if (size > _extern_size - _written) {
+      throw WriteError("Write exceeds caller-provided buffer");
+    }
+
+    std::copy(data, data + size, _extern + _written);
+    _written += size;
+    return;
+  }
+
   // Not sure what the default argument is here
   // NOLINTNEXTLINE(fuchsia-default-arguments)
-  _buffer.insert(_buffer.end(), bytes.begin(), bytes.end());
+  _buffer.insert(_buffer.end(), data, data + size);
 }
 
 // Primitive type writers
 ostream&
 ostream::write_uint(uint64_t value, int length)
 {
-  for (int i = length - 1; i >= 0; i -= 1) {
-    _buffer.push_back(value >> unsigned(8 * i));
+  std::array<uint8_t, 8> bytes;
+  for (int i = 0; i < length; i += 1) {
+    bytes[i] = value >> unsigned(8 * (length - i - 1));
   }
+  append(bytes.data(), length);
   return *this;
 }
 
@@ -44,16 +77,15 @@ operator<<(ostream& out, uint64_t data)
   return out.write_uint(data, 8);
 }
 
-// Because pop_back() on an empty vector is undefined
 uint8_t
 istream::next()
 {
-  if (_buffer.empty()) {
+  if (_pos == _size) {
     throw ReadError("Attempt to read from empty buffer");
   }
 
-  uint8_t value = _buffer.back();
-  _buffer.pop_back();
+  uint8_t value = _data[_pos];
+  _pos += 1;
   return value;
 }
 
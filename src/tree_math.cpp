@@ -3,6 +3,8 @@
 #include "tls_syntax.h"
 
 #include <algorithm>
+#include <map>
+#include <mutex>
 
 static uint32_t one = 0x01;
 
@@ -159,5 +161,72 @@ copath(NodeIndex x, NodeCount w)
   return c;
 }
 
+///
+/// PathTable
+///
+
+PathTable::PathTable(NodeCount w)
+  : _dirpaths(w.val)
+  , _copaths(w.val)
+{
+  for (uint32_t i = 0; i < w.val; i += 1) {
+    _dirpaths[i] = tree_math::dirpath(NodeIndex{ i }, w);
+
+    _copaths[i].resize(_dirpaths[i].size());
+    for (size_t j = 0; j < _dirpaths[i].size(); j += 1) {
+      _copaths[i][j] = sibling(_dirpaths[i][j], w);
+    }
+  }
+}
+
+const std::vector<NodeIndex>&
+PathTable::dirpath(NodeIndex x) const
+{
+  if (x.val >= _dirpaths.size()) {
+    throw InvalidParameterError("Node index outside the tree");
+  }
+
+  return _dirpaths[x.val];
+}
+
+const std::vector<NodeIndex>&
+PathTable::copath(NodeIndex x) const
+{
+  if (x.val >= _copaths.size()) {
+    throw InvalidParameterError("Node index outside the tree");
+  }
+
+  return _copaths[x.val];
+}
+
+std::shared_ptr<const PathTable>
+PathTable::get(NodeCount w)
+{
+  static const size_t max_cached_sizes = 4;
+  static std::mutex lock;
+  static std::map<uint32_t, std::shared_ptr<const PathTable>> cache;
+
+  std::unique_lock<std::mutex> guard(lock);
+  auto cached = cache.find(w.val);
+  if (cached != cache.end()) {
+    return cached->second;
+  }
+
+  // Building a table for a big tree is slow; release the lock while
+  // we do it
+  guard.unlock();
+  auto table = std::make_shared<const PathTable>(w);
+  guard.lock();
+
+  // Group sizes are stable for long stretches, so a full flush on
+  // overflow is simpler than LRU bookkeeping and nearly as good
+  if (cache.size() >= max_cached_sizes) {
+    cache.clear();
+  }
+
+  cache.emplace(w.val, table);
+  return table;
+}
+
 } // namespace tree_math
 } // namespace mls
@@ -0,0 +1,48 @@
+#include "common.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+
+using namespace mls;
+
+TEST(CommonTest, Zeroize)
+{
+  bytes data = from_hex("000102030405060708");
+  zeroize(data);
+  ASSERT_EQ(data, bytes(data.size(), 0));
+}
+
+TEST(CommonTest, SecureBytes)
+{
+  // secure_bytes behaves as a normal byte string
+  secure_bytes secret(32, 0xA0);
+  secret.push_back(0xA1);
+  ASSERT_EQ(secret.size(), 33);
+  ASSERT_EQ(secret[0], 0xA0);
+  ASSERT_EQ(secret[32], 0xA1);
+
+  auto copy = secret;
+  ASSERT_EQ(copy, secret);
+}
+
+TEST(CommonTest, SecurePool)
+{
+  SecureAllocator<uint8_t> alloc;
+
+  // Released blocks are zeroized and recycled: a second allocation in
+  // the same size class gets the same block back, scrubbed.  The pool
+  // retains ownership of released blocks, so inspecting the recycled
+  // block is well-defined.
+  auto* first = alloc.allocate(32);
+  std::fill(first, first + 32, 0xA0);
+  alloc.deallocate(first, 32);
+
+  auto* second = alloc.allocate(32);
+  ASSERT_EQ(second, first);
+  ASSERT_EQ(bytes(second, second + 32), bytes(32, 0));
+  alloc.deallocate(second, 32);
+
+  // Oversized blocks bypass the pool but still work
+  auto* large = alloc.allocate(1024);
+  std::fill(large, large + 1024, 0xA0);
+  alloc.deallocate(large, 1024);
+}
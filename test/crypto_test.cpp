@@ -230,6 +230,30 @@ TEST_F(CryptoTest, SHA2)
   ASSERT_EQ(Digest(DigestType::SHA512).write(sha2_in).digest(), sha512_out);
 }
 
+TEST_F(CryptoTest, SuiteTraits)
+{
+  static_assert(CipherSuiteTraits<CipherSuite::P256_SHA256_AES128GCM>::digest_size == 32,
+                "Incorrect digest size");
+  static_assert(CipherSuiteTraits<CipherSuite::P521_SHA512_AES256GCM>::digest_size == 64,
+                "Incorrect digest size");
+  static_assert(CipherSuiteTraits<CipherSuite::X25519_SHA256_AES128GCM>::key_size ==
+                  AESGCM::key_size_128,
+                "Incorrect key size");
+  static_assert(CipherSuiteTraits<CipherSuite::X448_SHA512_AES256GCM>::key_size ==
+                  AESGCM::key_size_256,
+                "Incorrect key size");
+
+  std::vector<CipherSuite> suites{ CipherSuite::P256_SHA256_AES128GCM,
+                                   CipherSuite::P521_SHA512_AES256GCM,
+                                   CipherSuite::X25519_SHA256_AES128GCM,
+                                   CipherSuite::X448_SHA512_AES256GCM };
+  for (auto suite : suites) {
+    ASSERT_EQ(suite_digest_size(suite), Digest(suite).output_size());
+    ASSERT_EQ(suite_key_size(suite), AESGCM::key_size(suite));
+    ASSERT_EQ(suite_nonce_size(suite), size_t(AESGCM::nonce_size));
+  }
+}
+
 TEST_F(CryptoTest, AES128GCM)
 {
   AESGCM enc(aes128gcm_key, aes128gcm_nonce);
@@ -252,6 +276,33 @@ TEST_F(CryptoTest, AES128GCM)
   ASSERT_EQ(rtt_dec.decrypt(rtt_dec.encrypt(rtt_pt)), rtt_pt);
 }
 
+TEST_F(CryptoTest, AESGCMNonceReuse)
+{
+  // One object encrypting a run of messages under the same key must
+  // agree with fresh objects per message
+  auto key = random_bytes(AESGCM::key_size_128);
+  auto pt = random_bytes(100);
+
+  auto nonce0 = random_bytes(AESGCM::nonce_size);
+  auto nonce1 = random_bytes(AESGCM::nonce_size);
+
+  AESGCM run_enc(key, nonce0);
+  auto ct0 = run_enc.encrypt(pt);
+  run_enc.set_nonce(nonce1);
+  auto ct1 = run_enc.encrypt(pt);
+
+  AESGCM enc0(key, nonce0);
+  AESGCM enc1(key, nonce1);
+  ASSERT_EQ(ct0, enc0.encrypt(pt));
+  ASSERT_EQ(ct1, enc1.encrypt(pt));
+  ASSERT_NE(ct0, ct1);
+
+  AESGCM run_dec(key, nonce0);
+  ASSERT_EQ(run_dec.decrypt(ct0), pt);
+  run_dec.set_nonce(nonce1);
+  ASSERT_EQ(run_dec.decrypt(ct1), pt);
+}
+
 TEST_F(CryptoTest, AES256GCM)
 {
   AESGCM enc(aes256gcm_key, aes256gcm_nonce);
@@ -328,6 +379,50 @@ TEST_F(CryptoTest, DHSerialize)
   }
 }
 
+TEST_F(CryptoTest, KeySharing)
+{
+  std::vector<CipherSuite> suites{ CipherSuite::P256_SHA256_AES128GCM,
+                                   CipherSuite::P521_SHA512_AES256GCM,
+                                   CipherSuite::X25519_SHA256_AES128GCM,
+                                   CipherSuite::X448_SHA512_AES256GCM };
+
+  for (auto suite : suites) {
+    auto x = DHPrivateKey::derive(suite, { 0, 1, 2, 3 });
+    auto y = DHPrivateKey::derive(suite, { 4, 5, 6, 7 });
+
+    // Copies share the underlying key; resetting one must not
+    // disturb the other
+    auto gX = x.public_key();
+    auto copy = gX;
+    copy.reset(y.public_key().to_bytes());
+    ASSERT_EQ(gX, x.public_key());
+    ASSERT_EQ(copy, y.public_key());
+    ASSERT_NE(copy, gX);
+  }
+}
+
+TEST_F(CryptoTest, KeyPool)
+{
+  const auto suite = CipherSuite::P256_SHA256_AES128GCM;
+  DHKeyPool::enable(suite, 4);
+
+  // Pooled keys must be distinct and usable for HPKE
+  auto a = DHPrivateKey::generate(suite);
+  auto b = DHPrivateKey::generate(suite);
+  ASSERT_NE(a, b);
+
+  auto plaintext = random_bytes(100);
+  auto encrypted = a.public_key().encrypt(plaintext);
+  ASSERT_EQ(a.decrypt(encrypted), plaintext);
+
+  DHKeyPool::disable();
+  ASSERT_EQ(DHKeyPool::available(suite), 0);
+
+  // With the pool disabled, generate falls back to a fresh keygen
+  auto c = DHPrivateKey::generate(suite);
+  ASSERT_NE(a, c);
+}
+
 TEST_F(CryptoTest, P256DH)
 {
   auto suite = CipherSuite::P256_SHA256_AES128GCM;
@@ -405,6 +500,43 @@ TEST_F(CryptoTest, HPKE)
   }
 }
 
+TEST_F(CryptoTest, HKDFLabelTemplate)
+{
+  auto suite = CipherSuite::P256_SHA256_AES128GCM;
+  auto secret = random_bytes(32);
+  auto context = random_bytes(16);
+
+  // The precompiled path produces the same output as the generic one
+  HKDFLabelTemplate tmpl("test", 32);
+  ASSERT_EQ(tmpl.expand(suite, secret, context),
+            hkdf_expand_label(suite, secret, "test", context, 32));
+  ASSERT_EQ(tmpl.expand(suite, secret, {}),
+            hkdf_expand_label(suite, secret, "test", {}, 32));
+}
+
+TEST_F(CryptoTest, VerifyBatch)
+{
+  // Large enough to take the parallel path, with mixed schemes
+  std::vector<SignatureBatchItem> items;
+  for (size_t i = 0; i < 10; i += 1) {
+    auto scheme = (i % 2 == 0) ? SignatureScheme::Ed25519
+                               : SignatureScheme::P256_SHA256;
+    auto priv = SignaturePrivateKey::generate(scheme);
+    auto message = random_bytes(64);
+    items.push_back({ priv.public_key(), message, priv.sign(message) });
+  }
+
+  ASSERT_TRUE(verify_batch(items));
+
+  // One bad signature fails the whole batch
+  items[5].signature[0] ^= 0xFF;
+  ASSERT_FALSE(verify_batch(items));
+
+  // The serial path agrees
+  items.erase(items.begin() + 3, items.end());
+  ASSERT_TRUE(verify_batch(items));
+}
+
 TEST_F(CryptoTest, BasicSignature)
 {
   std::vector<SignatureScheme> schemes{ SignatureScheme::P256_SHA256,
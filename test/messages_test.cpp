@@ -123,6 +123,117 @@ TEST_F(MessagesTest, UserInitKey)
   tls_round_trip(tv.user_init_key_all, constructed, after, reproducible);
 }
 
+TEST(HandshakeHeaderTest, Peek)
+{
+  const auto suite = CipherSuite::P256_SHA256_AES128GCM;
+  const auto scheme = SignatureScheme::P256_SHA256;
+
+  auto dh_priv = DHPrivateKey::derive(suite, { 0, 1, 2, 3 });
+  auto sig_priv = SignaturePrivateKey::derive(scheme, { 4, 5, 6, 7 });
+  auto cred = Credential::basic({ 8, 9 }, sig_priv);
+
+  mls::test::DeterministicHPKE lock;
+  auto secret = bytes(32, 0xA0);
+  auto tree = RatchetTree{ suite, { secret, secret, secret, secret } };
+  auto path = tree.encrypt(LeafIndex{ 0 }, secret);
+
+  UserInitKey uik;
+  uik.add_init_key(dh_priv.public_key());
+  uik.sign(sig_priv, cred);
+
+  auto signer = LeafIndex{ 2 };
+  auto epoch = epoch_t(0x11223344);
+  std::vector<Handshake> handshakes{
+    { epoch, Add{ LeafIndex{ 3 }, uik, secret }, signer, secret, secret },
+    { epoch, Update{ path }, signer, secret, secret },
+    { epoch, Remove{ LeafIndex{ 1 }, path }, signer, secret, secret },
+    { epoch,
+      BulkAdd{ LeafIndex{ 3 }, { uik, uik }, secret },
+      signer,
+      secret,
+      secret },
+  };
+
+  for (const auto& handshake : handshakes) {
+    auto encoded = tls::marshal(handshake);
+    auto header = HandshakeHeader::peek(encoded);
+    ASSERT_EQ(header.prior_epoch, handshake.prior_epoch);
+    ASSERT_EQ(header.operation_type, handshake.operation.type);
+    ASSERT_EQ(header.signer_index, handshake.signer_index);
+  }
+
+  // Truncated input is rejected
+  auto encoded = tls::marshal(handshakes[0]);
+  encoded.resize(6);
+  ASSERT_THROW(HandshakeHeader::peek(encoded), tls::ReadError);
+}
+
+TEST(WelcomeCompactTest, RoundTrip)
+{
+  const auto suite = CipherSuite::P256_SHA256_AES128GCM;
+  const auto scheme = SignatureScheme::P256_SHA256;
+
+  auto dh_priv = DHPrivateKey::derive(suite, { 0, 1, 2, 3 });
+  auto sig_priv = SignaturePrivateKey::derive(scheme, { 4, 5, 6, 7 });
+  auto cred = Credential::basic({ 8, 9 }, sig_priv);
+
+  auto secret = bytes(32, 0xB0);
+  auto tree = RatchetTree{ suite, { secret, secret, secret, secret } };
+  auto roster = Roster{};
+  roster.add(0, cred);
+
+  WelcomeInfo info{ { 0xAA, 0xBB }, 7, roster, tree, secret, secret };
+
+  // The compact encoding round-trips and is smaller than the
+  // canonical one
+  auto compact = info.compact();
+  ASSERT_LT(compact.size(), tls::marshal(info).size());
+  ASSERT_EQ(WelcomeInfo::decompact(suite, compact), info);
+
+  // Welcome::decrypt auto-detects the compact encoding
+  mls::test::DeterministicHPKE lock;
+  auto welcome =
+    Welcome::with_compact_info({ 0, 1 }, dh_priv.public_key(), info);
+  ASSERT_EQ(welcome.decrypt(dh_priv), info);
+}
+
+TEST(WelcomeCompactTest, Delta)
+{
+  const auto suite = CipherSuite::P256_SHA256_AES128GCM;
+  const auto scheme = SignatureScheme::P256_SHA256;
+
+  auto sig_priv = SignaturePrivateKey::derive(scheme, { 4, 5, 6, 7 });
+  auto cred = Credential::basic({ 8, 9 }, sig_priv);
+  auto new_cred = Credential::basic({ 10, 11 }, sig_priv);
+
+  auto secret = bytes(32, 0xB0);
+  auto tree = RatchetTree{ suite, { secret, secret, secret } };
+  auto roster = Roster{};
+  roster.add(0, cred);
+  roster.add(1, cred);
+  roster.add(2, cred);
+
+  WelcomeInfo prior{ { 0xAA, 0xBB }, 7, roster, tree, secret, secret };
+
+  // A later snapshot with a new member and a refreshed path
+  auto next = prior;
+  next.epoch += 1;
+  next.roster.add(3, new_cred);
+  next.tree.add_leaf(LeafIndex{ 3 }, secret);
+  next.tree.set_path(LeafIndex{ 3 }, secret);
+
+  auto delta = next.compact_delta(prior);
+  ASSERT_LT(delta.size(), next.compact().size());
+  ASSERT_EQ(WelcomeInfo::decompact_delta(prior, delta), next);
+
+  // A delta is rejected without its prior snapshot
+  ASSERT_THROW(WelcomeInfo::decompact(suite, delta), ProtocolError);
+
+  // ... and a full encoding is not a delta
+  ASSERT_THROW(WelcomeInfo::decompact_delta(prior, next.compact()),
+               ProtocolError);
+}
+
 TEST_F(MessagesTest, Suite_P256_P256)
 {
   tls_round_trip_all(tv.case_p256_p256, false);
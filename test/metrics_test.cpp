@@ -0,0 +1,63 @@
+#include "crypto.h"
+#include "metrics.h"
+#include "tls_syntax.h"
+#include <gtest/gtest.h>
+
+using namespace mls;
+
+// The hooks compile to nothing without MLS_METRICS, so there is
+// nothing to observe in that configuration
+#ifdef MLS_METRICS
+
+TEST(MetricsTest, Counters)
+{
+  metrics::reset();
+
+  auto suite = CipherSuite::P256_SHA256_AES128GCM;
+  auto data = from_hex("00010203");
+
+  Digest(suite).write(data).digest();
+
+  auto priv = DHPrivateKey::generate(suite);
+  auto encrypted = priv.public_key().encrypt(data);
+  priv.decrypt(encrypted);
+
+  tls::marshal(priv.public_key());
+
+  auto snap = metrics::snapshot();
+  ASSERT_GE(snap.counters.at("digest_bytes"), data.size());
+  ASSERT_EQ(snap.counters.at("hpke_encrypt"), 1);
+  ASSERT_EQ(snap.counters.at("hpke_decrypt"), 1);
+  ASSERT_GT(snap.counters.at("aes_gcm_encrypt"), 0);
+  ASSERT_GT(snap.counters.at("aes_gcm_decrypt"), 0);
+  ASSERT_GT(snap.counters.at("marshal_bytes"), 0);
+
+  metrics::reset();
+  snap = metrics::snapshot();
+  ASSERT_EQ(snap.counters.at("hpke_encrypt"), 0);
+}
+
+TEST(MetricsTest, Histograms)
+{
+  metrics::reset();
+
+  metrics::record_us(metrics::Timer::handshake_handle, 0);
+  metrics::record_us(metrics::Timer::handshake_handle, 3);
+  metrics::record_us(metrics::Timer::handshake_handle, 1000000);
+
+  auto snap = metrics::snapshot();
+  auto& hist = snap.timers.at("handshake_handle");
+  ASSERT_EQ(hist.count, 3);
+  ASSERT_EQ(hist.total_us, 1000003);
+  ASSERT_EQ(hist.buckets[0], 1);
+  ASSERT_EQ(hist.buckets[2], 1);
+
+  // 1,000,000 us is beyond the last dyadic bucket boundary, so it
+  // lands in the catch-all bucket
+  ASSERT_EQ(hist.buckets[metrics::Histogram::n_buckets - 1], 1);
+
+  // The untouched timers are present but empty
+  ASSERT_EQ(snap.timers.at("tree_encrypt").count, 0);
+}
+
+#endif // MLS_METRICS
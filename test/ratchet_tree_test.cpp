@@ -88,6 +88,125 @@ TEST_F(RatchetTreeTest, BySerializationWithBlanks)
   ASSERT_EQ(before, after);
 }
 
+TEST_F(RatchetTreeTest, InvariantTracking)
+{
+  auto priv = DHPrivateKey::node_derive(suite, secretB);
+
+  // A tree with private keys only on leaf 0's direct path
+  RatchetTree tree{ suite, secretA };
+  tree.add_leaf(LeafIndex{ 1 }, priv.public_key());
+  tree.set_path(LeafIndex{ 0 }, secretA);
+  ASSERT_TRUE(tree.check_invariant(LeafIndex{ 0 }));
+
+  // From leaf 1's perspective, those same keys violate the invariant
+  ASSERT_FALSE(tree.check_invariant(LeafIndex{ 1 }));
+
+  // Unmarshaling drops private keys, and the tracked set follows
+  RatchetTree after{ suite };
+  tls::unmarshal(tls::marshal(tree), after);
+  ASSERT_FALSE(after.check_invariant(LeafIndex{ 0 }));
+}
+
+TEST_F(RatchetTreeTest, CompactEncoding)
+{
+  RatchetTree before{ suite, { secretA, secretB, secretC, secretD } };
+  before.blank_path(LeafIndex{ 1 });
+
+  auto compact = before.compact();
+  ASSERT_LT(compact.size(), tls::marshal(before).size());
+
+  auto after = RatchetTree::decompact(suite, compact);
+  ASSERT_EQ(before, after);
+}
+
+TEST_F(RatchetTreeTest, CompactDelta)
+{
+  RatchetTree prior{ suite, { secretA, secretB, secretC } };
+  RatchetTree next = prior;
+  next.add_leaf(LeafIndex{ 3 }, secretD);
+  next.set_path(LeafIndex{ 3 }, secretD);
+
+  // The delta carries only the changed nodes
+  auto delta = next.compact_delta(prior);
+  ASSERT_LT(delta.size(), next.compact().size());
+  ASSERT_EQ(RatchetTree::decompact_delta(prior, delta), next);
+
+  // Shrinkage is also tracked
+  auto back = prior.compact_delta(next);
+  ASSERT_EQ(RatchetTree::decompact_delta(next, back), prior);
+}
+
+TEST_F(RatchetTreeTest, ParallelEncryptDecrypt)
+{
+  // With deterministic HPKE, the parallel mode must produce exactly
+  // the same DirectPath as the serial mode
+  test::DeterministicHPKE lock;
+
+  RatchetTree tree{ suite, { secretA, secretB, secretC, secretD } };
+  RatchetTree ptree = tree;
+  ptree.set_parallel(true);
+
+  auto leaf_secret = random_bytes(32);
+  auto ct = tree.encrypt(LeafIndex{ 0 }, leaf_secret);
+  auto pct = ptree.encrypt(LeafIndex{ 0 }, leaf_secret);
+  ASSERT_EQ(tls::marshal(ct), tls::marshal(pct));
+
+  auto info = tree.decrypt(LeafIndex{ 0 }, ct);
+  auto pinfo = ptree.decrypt(LeafIndex{ 0 }, ct);
+  ASSERT_EQ(info.secrets, pinfo.secrets);
+  ASSERT_TRUE(info.public_keys == pinfo.public_keys);
+
+  tree.merge_path(LeafIndex{ 0 }, info);
+  ptree.merge_path(LeafIndex{ 0 }, pinfo);
+  ASSERT_EQ(tree, ptree);
+}
+
+TEST_F(RatchetTreeTest, EncodingCacheInvalidation)
+{
+  RatchetTree before{ suite, { secretA, secretB, secretC, secretD } };
+  RatchetTree after{ suite };
+
+  // Populate the encoding cache, then mutate and re-marshal
+  auto enc0 = tls::marshal(before);
+  before.blank_path(LeafIndex{ 1 });
+  auto enc1 = tls::marshal(before);
+  ASSERT_NE(enc0, enc1);
+
+  tls::unmarshal(enc1, after);
+  ASSERT_EQ(before, after);
+}
+
+TEST_F(RatchetTreeTest, SparseStorage)
+{
+  const bool sparse = true;
+
+  // A sparse tree tracks a dense one through the same operations...
+  RatchetTree dense{ suite, { secretA, secretB, secretC, secretD } };
+  RatchetTree tree{ suite, { secretA, secretB, secretC, secretD }, sparse };
+  ASSERT_EQ(tree.size(), 4);
+  ASSERT_EQ(tree.root_secret(), secretABCD);
+  ASSERT_EQ(tree, dense);
+
+  dense.blank_path(LeafIndex{ 1 });
+  tree.blank_path(LeafIndex{ 1 });
+  ASSERT_EQ(tree, dense);
+
+  // ... and marshals to the same dense wire format
+  ASSERT_EQ(tls::marshal(tree), tls::marshal(dense));
+
+  RatchetTree after{ suite, sparse };
+  tls::unmarshal(tls::marshal(tree), after);
+  ASSERT_EQ(tree, after);
+
+  // Truncation releases the trailing nodes
+  dense.blank_path(LeafIndex{ 3 });
+  tree.blank_path(LeafIndex{ 3 });
+  dense.truncate(dense.leaf_span());
+  tree.truncate(tree.leaf_span());
+  ASSERT_EQ(tree.size(), 3);
+  ASSERT_EQ(tree, dense);
+}
+
 TEST_F(RatchetTreeTest, EncryptDecrypt)
 {
   size_t size = 5;
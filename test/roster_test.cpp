@@ -1,4 +1,5 @@
 #include "roster.h"
+#include "tls_syntax.h"
 #include <gtest/gtest.h>
 
 using namespace mls;
@@ -27,3 +28,26 @@ TEST(RosterTest, Basic)
   ASSERT_EQ(roster.get(0), cred);
   ASSERT_THROW(roster.get(1), InvalidParameterError);
 }
+
+TEST(RosterTest, LazyParse)
+{
+  auto scheme = SignatureScheme::Ed25519;
+  auto priv = SignaturePrivateKey::generate(scheme);
+  auto cred = Credential::basic(random_bytes(4), priv);
+
+  Roster roster;
+  roster.add(0, cred);
+
+  // Unmarshaling keeps only the raw credential bytes; the key is
+  // imported on first use and still verifies correctly
+  Roster parsed;
+  tls::unmarshal(tls::marshal(roster), parsed);
+  ASSERT_EQ(parsed, roster);
+
+  auto message = random_bytes(32);
+  auto signature = priv.sign(message);
+  ASSERT_TRUE(parsed.get(0).public_key().verify(message, signature));
+
+  // The round trip is stable through the deferred parse
+  ASSERT_EQ(tls::marshal(parsed), tls::marshal(roster));
+}
@@ -0,0 +1,82 @@
+#include "session_manager.h"
+#include <gtest/gtest.h>
+#include <set>
+
+using namespace mls;
+using namespace mls::test;
+
+class SessionManagerTest : public ::testing::Test
+{
+protected:
+  const CipherList suites{ CipherSuite::P256_SHA256_AES128GCM };
+  const SignatureScheme scheme = SignatureScheme::Ed25519;
+  const size_t n_groups = 4;
+  const size_t n_updates = 3;
+
+  TestSession make_session()
+  {
+    auto id_priv = SignaturePrivateKey::generate(scheme);
+    auto cred = Credential::basic({ 0, 1, 2, 3 }, id_priv);
+    return { suites, random_bytes(32), id_priv, cred };
+  }
+};
+
+TEST_F(SessionManagerTest, ParallelGroups)
+{
+  SessionManager manager(2);
+  std::vector<TestSession> others;
+  std::vector<bytes> group_ids;
+
+  // Each group has one managed member and one external counterparty
+  for (size_t i = 0; i < n_groups; i += 1) {
+    bytes group_id = { uint8_t(i) };
+    auto creator = make_session();
+    auto member = make_session();
+
+    auto welcome_add = creator.start(group_id, member.user_init_key());
+    member.join(welcome_add.first, welcome_add.second);
+
+    manager.add_session(group_id, creator);
+    others.push_back(member);
+    group_ids.push_back(group_id);
+  }
+
+  // The counterparties send a few rounds of updates; every ticket
+  // comes back successful
+  std::set<uint64_t> tickets;
+  for (size_t gen = 0; gen < n_updates; gen += 1) {
+    for (size_t i = 0; i < n_groups; i += 1) {
+      auto update = others[i].update(random_bytes(32));
+      others[i].handle(update);
+      tickets.insert(manager.submit(group_ids[i], update));
+    }
+  }
+
+  manager.flush();
+  auto results = manager.poll();
+  ASSERT_EQ(results.size(), tickets.size());
+  for (const auto& result : results) {
+    ASSERT_TRUE(result.ok) << result.error;
+    tickets.erase(result.ticket);
+  }
+  ASSERT_TRUE(tickets.empty());
+
+  // The managed sessions ended up in sync with their counterparties
+  for (size_t i = 0; i < n_groups; i += 1) {
+    manager.with_session(group_ids[i], [&](Session& session) {
+      ASSERT_EQ(session, others[i]);
+    });
+  }
+
+  // Malformed input is reported in the result, not thrown
+  manager.submit(group_ids[0], bytes(8, 0));
+  manager.flush();
+  results = manager.poll();
+  ASSERT_EQ(results.size(), 1);
+  ASSERT_FALSE(results[0].ok);
+
+  // Removal drops the group and further submits are rejected
+  manager.remove_session(group_ids[0]);
+  ASSERT_EQ(manager.size(), n_groups - 1);
+  ASSERT_THROW(manager.submit(group_ids[0], bytes(1, 0)), MissingStateError);
+}
@@ -176,6 +176,43 @@ TEST_F(RunningSessionTest, Update)
   }
 }
 
+TEST_F(RunningSessionTest, AsyncHandle)
+{
+  auto initial_epoch = sessions[0].current_epoch();
+  auto update_secret = fresh_secret();
+  auto update = sessions[0].update(update_secret);
+
+  // Run the prepare stage for all sessions in parallel, then commit
+  std::vector<std::future<Session::PendingHandshake>> pending;
+  for (auto& session : sessions) {
+    pending.push_back(session.handle_async(update));
+  }
+
+  for (int i = 0; i < group_size; i += 1) {
+    sessions[i].commit(pending[i].get());
+  }
+
+  check(initial_epoch);
+}
+
+TEST_F(RunningSessionTest, HandshakeDedup)
+{
+  HandshakeCache::reset();
+
+  auto initial_epoch = sessions[0].current_epoch();
+  auto update = sessions[0].update(fresh_secret());
+
+  // Identical deliveries share one parse
+  auto suite = sessions[0].cipher_suite();
+  auto first = HandshakeCache::parse(suite, update);
+  auto second = HandshakeCache::parse(suite, update);
+  ASSERT_EQ(first, second);
+
+  // The fan-in path still lands every member in a consistent state
+  broadcast(update);
+  check(initial_epoch);
+}
+
 TEST_F(RunningSessionTest, Remove)
 {
   for (int i = group_size - 1; i > 0; i -= 1) {
@@ -188,6 +225,44 @@ TEST_F(RunningSessionTest, Remove)
   }
 }
 
+TEST_F(RunningSessionTest, SaveRestore)
+{
+  // A restored session picks up exactly where the original left off
+  auto snapshot = sessions[0].save();
+  auto restored = Session::restore(snapshot);
+  ASSERT_EQ(restored, sessions[0]);
+
+  // ... and can keep processing handshakes
+  auto initial_epoch = sessions[0].current_epoch();
+  auto update = sessions[1].update(fresh_secret());
+  restored.handle(update);
+  broadcast(update);
+  check(initial_epoch);
+  ASSERT_EQ(restored, sessions[0]);
+}
+
+TEST_F(RunningSessionTest, EpochRetention)
+{
+  std::vector<epoch_t> evicted;
+  sessions[0].set_retention(2);
+  sessions[0].set_eviction_handler(
+    [&](epoch_t epoch, const State&) { evicted.push_back(epoch); });
+
+  for (int i = 0; i < group_size; i += 1) {
+    auto initial_epoch = sessions[0].current_epoch();
+    auto update = sessions[i].update(fresh_secret());
+    broadcast(update);
+    check(initial_epoch);
+    ASSERT_LE(sessions[0].resident_epochs(), 2);
+  }
+
+  // Evicted epochs were reported oldest-first
+  ASSERT_FALSE(evicted.empty());
+  for (size_t i = 1; i < evicted.size(); i += 1) {
+    ASSERT_LT(evicted[i - 1], evicted[i]);
+  }
+}
+
 TEST_F(RunningSessionTest, Replace)
 {
   for (int i = 0; i < group_size; ++i) {
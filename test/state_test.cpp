@@ -36,6 +36,29 @@ TEST_F(AppKeyScheduleTest, Interop)
   interop(CipherSuite::X25519_SHA256_AES128GCM, tv.case_x25519);
 }
 
+TEST_F(AppKeyScheduleTest, Ratcheting)
+{
+  const auto suite = CipherSuite::P256_SHA256_AES128GCM;
+  const uint32_t window_size = 4;
+
+  ApplicationKeyChain const_chain(suite, 0, tv.application_secret);
+  ApplicationKeyChain chain(suite, 0, tv.application_secret, window_size);
+
+  // Keys within the window match const mode, in and out of order
+  auto kn3 = chain.get(3);
+  auto kn1 = chain.get(1);
+  ASSERT_EQ(kn3.key, const_chain.get(3).key);
+  ASSERT_EQ(kn1.key, const_chain.get(1).key);
+  ASSERT_EQ(kn1.nonce, const_chain.get(1).nonce);
+
+  // Advancing far ahead slides the window, after which old
+  // generations are no longer available
+  chain.get(10);
+  ASSERT_EQ(chain.get(8).key, const_chain.get(8).key);
+  ASSERT_THROW(chain.get(1), ProtocolError);
+  ASSERT_THROW(chain.get(6), ProtocolError);
+}
+
 class StateTest : public ::testing::Test
 {
 protected:
@@ -122,6 +145,35 @@ TEST_F(GroupCreationTest, FullSize)
   }
 }
 
+TEST_F(GroupCreationTest, BulkAdd)
+{
+  // The creator adds everyone else in one batch
+  auto first = State{
+    group_id, suite, init_secrets[0], identity_privs[0], credentials[0]
+  };
+
+  std::vector<UserInitKey> batch(user_init_keys.begin() + 1,
+                                 user_init_keys.end());
+  auto welcomes_add = first.add(batch);
+  auto welcomes = welcomes_add.first;
+  auto bulk_add = welcomes_add.second;
+  ASSERT_EQ(welcomes.size(), group_size - 1);
+
+  // One epoch change covers the whole batch
+  first = first.handle(bulk_add);
+  ASSERT_EQ(first.epoch(), 1);
+
+  // Each new member joins from their own Welcome
+  for (size_t i = 1; i < group_size; i += 1) {
+    auto joiner = State{ identity_privs[i],
+                         credentials[i],
+                         init_secrets[i],
+                         welcomes[i - 1],
+                         bulk_add };
+    ASSERT_EQ(joiner, first);
+  }
+}
+
 class RunningGroupTest : public StateTest
 {
 protected:
@@ -184,6 +236,73 @@ TEST_F(RunningGroupTest, Update)
   }
 }
 
+TEST_F(RunningGroupTest, HandleBatch)
+{
+  // Everyone except the last member sends an update; the last member
+  // catches up on the whole run at once
+  std::vector<Handshake> handshakes;
+  for (size_t i = 0; i + 1 < group_size; i += 1) {
+    auto update = states[i].update(random_bytes(32));
+    handshakes.push_back(update);
+
+    for (size_t j = 0; j + 1 < group_size; j += 1) {
+      states[j] = states[j].handle(update);
+    }
+  }
+
+  states[group_size - 1] = states[group_size - 1].handle_batch(handshakes);
+  check_consistency();
+
+  // Replaying the run from the wrong epoch is rejected
+  ASSERT_THROW(states[0].handle_batch(handshakes), InvalidParameterError);
+}
+
+TEST_F(RunningGroupTest, SnapshotRestore)
+{
+  // Every member's full state round-trips through a snapshot
+  for (size_t i = 0; i < group_size; i += 1) {
+    auto restored = State::restore(states[i].snapshot());
+    ASSERT_EQ(restored, states[i]);
+  }
+
+  // A restored state can continue processing handshakes
+  auto restored = State::restore(states[1].snapshot());
+  auto update = states[0].update(random_bytes(32));
+  for (auto& state : states) {
+    state = state.handle(update);
+  }
+  restored = restored.handle(update);
+  ASSERT_EQ(restored, states[0]);
+}
+
+TEST_F(RunningGroupTest, VerifyBatch)
+{
+  std::vector<Handshake> handshakes;
+  for (size_t i = 0; i + 1 < group_size; i += 1) {
+    auto update = states[i].update(random_bytes(32));
+    handshakes.push_back(update);
+
+    for (size_t j = 0; j + 1 < group_size; j += 1) {
+      states[j] = states[j].handle(update);
+    }
+  }
+
+  // Pre-validation from the catching-up member's state succeeds
+  auto& last = states[group_size - 1];
+  ASSERT_TRUE(last.verify_batch(handshakes));
+
+  // A tampered signature fails the batch
+  auto tampered = handshakes;
+  tampered[1].signature[0] ^= 0xFF;
+  ASSERT_FALSE(last.verify_batch(tampered));
+
+  // The wrong starting epoch fails the batch
+  ASSERT_FALSE(states[0].verify_batch(handshakes));
+
+  last = last.handle_batch(handshakes);
+  check_consistency();
+}
+
 TEST_F(RunningGroupTest, Remove)
 {
   for (int i = group_size - 2; i > 0; i -= 1) {
@@ -196,4 +196,42 @@ TEST_F(TLSSyntaxTest, IStream)
   istream_test(val_var_optional, data_var_optional, enc_var_optional);
 }
 
+TEST_F(TLSSyntaxTest, OStreamModes)
+{
+  // Counting mode computes the encoded size without writing
+  ASSERT_EQ(tls::marshal_size(val_struct), enc_struct.size());
+
+  // Wrapped mode writes into a caller-provided buffer, and refuses
+  // to overrun it
+  bytes buffer(enc_struct.size());
+  auto written = tls::marshal_into(val_struct, buffer.data(), buffer.size());
+  ASSERT_EQ(written, enc_struct.size());
+  ASSERT_EQ(buffer, enc_struct);
+
+  bytes small(enc_struct.size() - 1);
+  ASSERT_THROW(tls::marshal_into(val_struct, small.data(), small.size()),
+               tls::WriteError);
+}
+
+TEST_F(TLSSyntaxTest, IStreamRef)
+{
+  // Reading from a non-owning stream over an external buffer
+  ExampleStruct data_struct;
+  auto r = tls::istream::ref(enc_struct.data(), enc_struct.size());
+  r >> data_struct;
+  ASSERT_EQ(data_struct, val_struct);
+
+  // An opaque_ref aliases the input instead of copying it
+  tls::opaque_ref<3> ref;
+  auto r2 = tls::istream::ref(enc_vector.data(), enc_vector.size());
+  r2 >> ref;
+  ASSERT_EQ(ref.size, size_t(8));
+  ASSERT_EQ(ref.data, enc_vector.data() + 3);
+
+  // Zero-copy unmarshal
+  tls::vector<uint32_t, 3> data_vector;
+  tls::unmarshal(enc_vector.data(), enc_vector.size(), data_vector);
+  ASSERT_EQ(data_vector, val_vector);
+}
+
 // TODO(rlb@ipv.sx) Test failure cases
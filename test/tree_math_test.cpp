@@ -66,6 +66,26 @@ TEST_F(TreeMathTest, Sibling)
   vector_test(size_scope(tree_math::sibling), tv.sibling);
 }
 
+TEST(PathTableTest, MatchesDirectComputation)
+{
+  for (uint32_t n : { 1, 2, 5, 11, 32 }) {
+    auto w = NodeCount{ LeafCount{ n } };
+    auto table = tree_math::PathTable::get(w);
+
+    for (uint32_t i = 0; i < w.val; i += 1) {
+      auto x = NodeIndex{ i };
+      ASSERT_EQ(table->dirpath(x), tree_math::dirpath(x, w));
+      ASSERT_EQ(table->copath(x), tree_math::copath(x, w));
+    }
+
+    ASSERT_THROW(table->dirpath(NodeIndex{ w.val }), InvalidParameterError);
+  }
+
+  // Repeated lookups for the same size share one table
+  auto w = NodeCount{ LeafCount{ 5 } };
+  ASSERT_EQ(tree_math::PathTable::get(w), tree_math::PathTable::get(w));
+}
+
 TEST(ResolutionTest, Interop)
 {
   auto tv = TestLoader<ResolutionTestVectors>::get();